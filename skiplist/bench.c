@@ -0,0 +1,847 @@
+/*
+skiplist的benchmark, 结果以CSV输出, 方便不同版本之间对比.
+不带参数时运行一组默认的workload: 所有key类型 x 所有key分布 x 读/写/排名/范围四种操作比例.
+
+用法: ./bench [--type=u32|i32|u64|i64|str] [--dist=uniform|zipf|seq|cluster]
+              [--n=初始节点数] [--ops=操作数] [--mix=find:insert:remove:rank:range]
+              [--flags=arena,prefix,prefetch] [--seed=随机数种子] [--case=名字]
+指定了任何一个参数时只运行一个workload, 其他参数使用默认值.
+指定--case时不运行workload, 而是运行一个对比同一件事的不同做法的case(见bench_cases), 例如
+    ./bench --case=node_handle --n=1000000
+
+每个workload先插入n个key(记为load阶段), 再按mix的比例执行ops次操作, 每次操作单独计时:
+    find    skip_list_find
+    insert  skip_list_insert
+    remove  skip_list_remove
+    rank    skip_list_get_rank和skip_list_get_node_by_rank交替
+    range   skip_list_count_range, 再从lower_bound开始遍历最多RANGE_SCAN个节点
+输出每个阶段的吞吐量(mops), 平均延迟, p50/p99/p999延迟(纳秒, CLOCK_MONOTONIC),
+以及进程到目前为止的峰值RSS(KB).
+*/
+
+#define NDEBUG
+
+#include "skiplist.h"
+#include "skiplist32.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+
+
+#define RANGE_SCAN 50
+#define CLUSTERS 64
+#define CLUSTER_WIDTH 1024
+
+
+enum { OP_FIND, OP_INSERT, OP_REMOVE, OP_RANK, OP_RANGE, OP_COUNT };
+
+enum { DIST_UNIFORM, DIST_ZIPF, DIST_SEQ, DIST_CLUSTER, DIST_COUNT };
+
+static const char * const dist_names[DIST_COUNT] = {"uniform", "zipf", "seq", "cluster"};
+
+static const element_type_t bench_types[] = {TINT32, TUINT32, TINT64, TUINT64, TSTR};
+
+
+typedef struct bench_config {
+    element_type_t type;
+    int dist;
+    unsigned long n;
+    unsigned long ops;
+    unsigned int mix[OP_COUNT]; //百分比
+    unsigned int flags;
+    uint64_t seed;
+} bench_config_t;
+
+
+/*
+key生成: 先生成一个64位的整数, 再按类型转换成element_t.
+uniform: [0, 2n)中均匀分布, 查找大约一半命中
+zipf: 按排名服从zipf(0.99)分布, 再打散到[0, 2n)中, 热点key不相邻
+seq: 递增的序号, 查找和删除集中在最近插入的key附近
+cluster: 随机选一个簇, 簇内的key连续
+*/
+typedef struct key_gen {
+    int dist;
+    uint64_t rng;
+    uint64_t space; //key的范围
+    uint64_t next_seq;
+    uint64_t centers[CLUSTERS];
+    //zipf参数, 参考Gray等人的"Quickly Generating Billion-Record Synthetic Databases"
+    double theta, alpha, zetan, eta;
+} key_gen_t;
+
+
+static inline uint64_t rng_next(uint64_t *s){
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+
+static inline double rng_double(uint64_t *s){
+    return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+//把[0, space)中的排名打散, 是一个双射的近似: 乘以奇数后取模
+static inline uint64_t scramble(uint64_t x, uint64_t space){
+    return (x * 0x9e3779b97f4a7c15ULL) % space;
+}
+
+
+static void key_gen_init(key_gen_t *g, int dist, unsigned long n, uint64_t seed){
+    memset(g, 0, sizeof(*g));
+    g->dist = dist;
+    g->rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+    g->space = 2 * (uint64_t)n + 1;
+    for(int i=0; i<CLUSTERS; i++){
+        g->centers[i] = rng_next(&g->rng) % g->space;
+    }
+    if(dist == DIST_ZIPF){
+        g->theta = 0.99;
+        double zeta2 = 1.0 + pow(0.5, g->theta);
+        for(uint64_t i=1; i<=g->space; i++){
+            g->zetan += 1.0 / pow((double)i, g->theta);
+        }
+        g->alpha = 1.0 / (1.0 - g->theta);
+        g->eta = (1.0 - pow(2.0 / g->space, 1.0 - g->theta)) / (1.0 - zeta2 / g->zetan);
+    }
+}
+
+
+//insert为true时生成一个要插入的key, seq分布下是下一个序号
+static uint64_t key_gen_next(key_gen_t *g, bool insert){
+    switch(g->dist){
+    case DIST_ZIPF: {
+        double u = rng_double(&g->rng);
+        double uz = u * g->zetan;
+        uint64_t rank;
+        if(uz < 1.0){
+            rank = 0;
+        }else if(uz < 1.0 + pow(0.5, g->theta)){
+            rank = 1;
+        }else{
+            rank = (uint64_t)(g->space * pow(g->eta * u - g->eta + 1, g->alpha));
+        }
+        return scramble(rank, g->space);
+    }
+    case DIST_SEQ:
+        if(insert || g->next_seq == 0){
+            return g->next_seq++;
+        }
+        return g->next_seq - 1 - rng_next(&g->rng) % (g->next_seq < 1024 ? g->next_seq : 1024);
+    case DIST_CLUSTER:
+        return (g->centers[rng_next(&g->rng) % CLUSTERS] + rng_next(&g->rng) % CLUSTER_WIDTH) % g->space;
+    default:
+        return rng_next(&g->rng) % g->space;
+    }
+}
+
+
+//字符串key格式化到buf中, list使用SKIP_LIST_KEY_COPY保存插入的key
+static inline element_t make_key(element_type_t type, uint64_t x, char *buf){
+    element_t e;
+    switch(type){
+    case TINT32: e.i32 = (int32_t)(uint32_t)x; break;
+    case TUINT32: e.u32 = (uint32_t)x; break;
+    case TINT64: e.i64 = (int64_t)(x - (UINT64_MAX >> 1)); break;
+    case TUINT64: e.u64 = x << 20 | (x & 0xfffff); break;
+    default: sprintf(buf, "key:%016lx", (unsigned long)x); e.s = buf; break;
+    }
+    return e;
+}
+
+
+static inline uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int compare_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+
+static void report(const bench_config_t *c, const char *phase, uint64_t *lat, unsigned long count, uint64_t total_ns){
+    qsort(lat, count, sizeof(*lat), compare_u64);
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    char flags[64] = "";
+    if(c->flags & SKIP_LIST_ARENA) strcat(flags, "arena|");
+    if(c->flags & SKIP_LIST_KEY_PREFIX) strcat(flags, "prefix|");
+    if(c->flags & SKIP_LIST_PREFETCH) strcat(flags, "prefetch|");
+    if(flags[0] != '\0') flags[strlen(flags)-1] = '\0'; else strcpy(flags, "none");
+    printf("%s,%s,%s,%s,%lu,%lu,%u:%u:%u:%u:%u,%.3f,%.1f,%lu,%lu,%lu,%ld\n",
+           phase, ELEMENT_TYPEIDNAME(c->type), dist_names[c->dist], flags, c->n, count,
+           c->mix[OP_FIND], c->mix[OP_INSERT], c->mix[OP_REMOVE], c->mix[OP_RANK], c->mix[OP_RANGE],
+           count * 1e3 / total_ns, (double)total_ns / count,
+           (unsigned long)lat[count / 2], (unsigned long)lat[count * 99 / 100], (unsigned long)lat[count * 999 / 1000],
+           ru.ru_maxrss);
+    fflush(stdout);
+}
+
+
+//[0, 2n)中的n个奇数, 随机顺序
+static uint64_t *shuffled_odd(unsigned long n, uint64_t *rng){
+    uint64_t *perm = malloc(n * sizeof(*perm));
+    for(unsigned long i=0; i<n; i++){
+        unsigned long j = rng_next(rng) % (i + 1);
+        perm[i] = perm[j];
+        perm[j] = 2 * i + 1;
+    }
+    return perm;
+}
+
+
+static void bench_run(const bench_config_t *c){
+    unsigned int flags = c->flags;
+    if(c->type == TSTR){
+        flags |= SKIP_LIST_KEY_COPY;
+    }
+    skip_list_t *l = skip_list_create(c->type, TUINT64, compare_func_list[c->type], flags);
+    key_gen_t gen;
+    key_gen_init(&gen, c->dist, c->n, c->seed);
+    char buf[32], buf2[32];
+    unsigned long max = c->n > c->ops ? c->n : c->ops;
+    uint64_t *lat = malloc(max * sizeof(*lat));
+
+    //load: 按随机顺序插入[0, 2n)中的n个奇数, 这样节点在内存中的顺序和key的顺序无关, 查找大约一半命中.
+    //seq分布按顺序插入0到n-1
+    uint64_t rng = c->seed ^ 0x5851f42d4c957f2dULL;
+    uint64_t *perm = shuffled_odd(c->n, &rng);
+    uint64_t total = 0;
+    for(unsigned long i=0; i<c->n; i++){
+        uint64_t x = c->dist == DIST_SEQ ? key_gen_next(&gen, true) : perm[i];
+        element_t key = make_key(c->type, x, buf);
+        uint64_t t = now_ns();
+        skip_list_insert(l, key, (element_t)(uint64_t)i);
+        lat[i] = now_ns() - t;
+        total += lat[i];
+    }
+    if(c->n > 0){
+        report(c, "load", lat, c->n, total);
+    }
+
+    //按mix的比例执行操作, 操作的顺序由种子决定
+    unsigned int cumulative[OP_COUNT];
+    unsigned int sum = 0;
+    for(int op=0; op<OP_COUNT; op++){
+        sum += c->mix[op];
+        cumulative[op] = sum;
+    }
+    unsigned long found = 0;
+    total = 0;
+    for(unsigned long i=0; i<c->ops && sum>0; i++){
+        unsigned int r = rng_next(&rng) % sum;
+        int op = 0;
+        while(r >= cumulative[op]){
+            op++;
+        }
+        element_t key = make_key(c->type, key_gen_next(&gen, op == OP_INSERT), buf);
+        element_t hi = make_key(c->type, key_gen_next(&gen, false), buf2);
+        unsigned long rank = l->length > 0 ? rng_next(&rng) % l->length + 1 : 0;
+
+        uint64_t t = now_ns();
+        switch(op){
+        case OP_FIND:
+            found += skip_list_find(l, key) != NULL;
+            break;
+        case OP_INSERT:
+            found += skip_list_insert(l, key, (element_t)(uint64_t)i) != NULL;
+            break;
+        case OP_REMOVE:
+            found += skip_list_remove(l, key);
+            break;
+        case OP_RANK:
+            found += i & 1 ? skip_list_get_rank(l, key) : skip_list_get_node_by_rank(l, rank) != NULL;
+            break;
+        case OP_RANGE: {
+            if(l->compare(hi, key) < 0){
+                element_t tmp = hi;
+                hi = key;
+                key = tmp;
+            }
+            found += skip_list_count_range(l, key, hi);
+            skip_node_t *node = skip_list_lower_bound(l, key);
+            for(int k=0; node!=NULL && node!=l->header && k<RANGE_SCAN; k++, node=node->level[0].forward){
+                found += node->value.u64 & 1;
+            }
+            break;
+        }
+        }
+        lat[i] = now_ns() - t;
+        total += lat[i];
+    }
+    if(c->ops > 0 && sum > 0){
+        report(c, "ops", lat, c->ops, total);
+    }
+    if(found == (unsigned long)-1){
+        printf("\n"); //不让编译器优化掉结果
+    }
+
+    free(perm);
+    free(lat);
+    skip_list_destroy(l);
+}
+
+
+/*
+case: 同一件事的不同做法在同样的数据上分别计时, 每种做法输出一行, phase是做法的名字.
+key固定是u32, 不受--type影响; list按--flags创建, 先按load阶段同样的方式插入n个key.
+批量的操作(例如一次find_batch或者union)的时间平均到其中的每个元素上, 这样每一行的mops和延迟都是按元素计算的, 可以直接比较.
+*/
+typedef struct bench_timer {
+    uint64_t *lat;
+    unsigned long count;
+    uint64_t total;
+    uint64_t begin;
+} bench_timer_t;
+
+
+static void timer_init(bench_timer_t *t, unsigned long capacity){
+    t->lat = malloc((capacity > 0 ? capacity : 1) * sizeof(*t->lat));
+    t->count = 0;
+    t->total = 0;
+}
+
+
+static inline void timer_start(bench_timer_t *t){
+    t->begin = now_ns();
+}
+
+
+//一次调用处理了n个元素
+static inline void timer_stop_n(bench_timer_t *t, unsigned long n){
+    uint64_t d = now_ns() - t->begin;
+    for(unsigned long i=0; i<n; i++){
+        t->lat[t->count++] = d / n;
+    }
+    t->total += d;
+}
+
+
+static inline void timer_stop(bench_timer_t *t){
+    timer_stop_n(t, 1);
+}
+
+
+//输出一行并清空, 可以继续给下一种做法使用
+static void timer_report(const bench_config_t *c, const char *phase, bench_timer_t *t){
+    if(t->count > 0){
+        report(c, phase, t->lat, t->count, t->total);
+    }
+    t->count = 0;
+    t->total = 0;
+}
+
+
+//n个互不相同的u32 key, 按load阶段的顺序
+static uint32_t *case_keys(const bench_config_t *c){
+    uint64_t rng = c->seed ^ 0x5851f42d4c957f2dULL;
+    uint64_t *perm = shuffled_odd(c->n, &rng);
+    uint32_t *keys = malloc((c->n > 0 ? c->n : 1) * sizeof(*keys));
+    for(unsigned long i=0; i<c->n; i++){
+        keys[i] = c->dist == DIST_SEQ ? (uint32_t)i : (uint32_t)perm[i];
+    }
+    free(perm);
+    return keys;
+}
+
+
+static skip_list_t *case_list(const bench_config_t *c, const uint32_t *keys, skip_node_t **nodes){
+    skip_list_t *l = skip_list_create(TUINT32, TUINT32, compare_func_list[TUINT32], c->flags);
+    for(unsigned long i=0; i<c->n; i++){
+        skip_node_t *node = skip_list_insert(l, (element_t)keys[i], (element_t)(uint32_t)i);
+        if(nodes != NULL){
+            nodes[i] = node;
+        }
+    }
+    return l;
+}
+
+
+//节点句柄: get_rank/remove按key从header查找, get_node_rank/remove_node直接从节点出发(-DSKIPLIST_BACKLINKS时不需要查找)
+static void case_node_handle(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_node_t **nodes = malloc((c->n > 0 ? c->n : 1) * sizeof(*nodes));
+    skip_list_t *l = case_list(c, keys, nodes);
+    bench_timer_t t;
+    timer_init(&t, c->n > c->ops ? c->n : c->ops);
+    uint64_t rng = c->seed;
+    unsigned long sum = 0;
+    for(int v=0; v<2 && c->n>0; v++){
+        for(unsigned long i=0; i<c->ops; i++){
+            unsigned long k = rng_next(&rng) % c->n;
+            timer_start(&t);
+            sum += v == 0 ? skip_list_get_rank(l, (element_t)keys[k]) : skip_list_get_node_rank(l, nodes[k]);
+            timer_stop(&t);
+        }
+        timer_report(c, v == 0 ? "get_rank" : "get_node_rank", &t);
+    }
+    //按同样的随机顺序删除所有节点
+    uint64_t *order = shuffled_odd(c->n, &rng);
+    for(int v=0; v<2; v++){
+        if(v == 1){
+            skip_list_destroy(l);
+            l = case_list(c, keys, nodes);
+        }
+        for(unsigned long i=0; i<c->n; i++){
+            unsigned long k = (order[i] - 1) / 2;
+            timer_start(&t);
+            if(v == 0){
+                sum += skip_list_remove(l, (element_t)keys[k]);
+            }else{
+                skip_list_remove_node(l, nodes[k]);
+            }
+            timer_stop(&t);
+        }
+        timer_report(c, v == 0 ? "remove" : "remove_node", &t);
+    }
+    if(sum == (unsigned long)-1){
+        printf("\n"); //不让编译器优化掉结果
+    }
+    free(t.lat);
+    free(order);
+    free(nodes);
+    free(keys);
+    skip_list_destroy(l);
+}
+
+
+//同样的u32->u32插入和查找, 普通skiplist(按--flags创建)和32位下标的skiplist32
+static void case_skiplist32(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_list_t *l = skip_list_create(TUINT32, TUINT32, compare_func_list[TUINT32], c->flags);
+    skip_list32_t *l32 = skip_list32_create(TUINT32, TUINT32);
+    bench_timer_t t;
+    timer_init(&t, c->n > c->ops ? c->n : c->ops);
+    for(int v=0; v<2; v++){
+        for(unsigned long i=0; i<c->n; i++){
+            timer_start(&t);
+            if(v == 0){
+                skip_list_insert(l, (element_t)keys[i], (element_t)(uint32_t)i);
+            }else{
+                skip_list32_insert(l32, keys[i], (uint32_t)i);
+            }
+            timer_stop(&t);
+        }
+        timer_report(c, v == 0 ? "skiplist_insert" : "skiplist32_insert", &t);
+    }
+    uint64_t rng = c->seed;
+    unsigned long found = 0;
+    for(int v=0; v<2 && c->n>0; v++){
+        for(unsigned long i=0; i<c->ops; i++){
+            uint32_t key = keys[rng_next(&rng) % c->n];
+            timer_start(&t);
+            found += v == 0 ? skip_list_find(l, (element_t)key) != NULL : skip_list32_find(l32, key) != 0;
+            timer_stop(&t);
+        }
+        timer_report(c, v == 0 ? "skiplist_find" : "skiplist32_find", &t);
+    }
+    if(found == (unsigned long)-1){
+        printf("\n"); //不让编译器优化掉结果
+    }
+    free(t.lat);
+    free(keys);
+    skip_list_destroy(l);
+    skip_list32_destroy(l32);
+}
+
+
+//排行榜: 随机一个节点的key增加[0, 100), update_key移动同一个节点, 对比remove_node+insert_multi
+static void case_update_key(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_node_t **nodes = malloc((c->n > 0 ? c->n : 1) * sizeof(*nodes));
+    bench_timer_t t;
+    timer_init(&t, c->ops);
+    for(int v=0; v<2 && c->n>0; v++){
+        skip_list_t *l = case_list(c, keys, nodes);
+        uint64_t rng = c->seed;
+        for(unsigned long i=0; i<c->ops; i++){
+            uint64_t r = rng_next(&rng);
+            unsigned long p = r % c->n;
+            element_t key = {.u32 = nodes[p]->key.u32 + (uint32_t)(r >> 32) % 100};
+            timer_start(&t);
+            if(v == 0){
+                skip_list_update_key(l, nodes[p], key);
+            }else{
+                skip_list_remove_node(l, nodes[p]);
+                nodes[p] = skip_list_insert_multi(l, key, (element_t)(uint32_t)p);
+            }
+            timer_stop(&t);
+        }
+        timer_report(c, v == 0 ? "update_key" : "remove_node+insert_multi", &t);
+        skip_list_destroy(l);
+    }
+    free(t.lat);
+    free(nodes);
+    free(keys);
+}
+
+
+//延迟的百分位: 一次quantiles合并查找7个百分位, 对比每个百分位单独get_node_by_rank
+static void case_quantiles(const bench_config_t *c){
+    static const double qs[] = {0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 0.9999};
+    enum { NQ = sizeof(qs) / sizeof(qs[0]) };
+    uint32_t *keys = case_keys(c);
+    skip_list_t *l = case_list(c, keys, NULL);
+    skip_node_t *out[NQ];
+    unsigned long ranks[NQ];
+    for(int j=0; j<NQ; j++){
+        ranks[j] = (unsigned long)(qs[j] * c->n);
+        ranks[j] += ranks[j] < qs[j] * c->n;
+    }
+    bench_timer_t t;
+    timer_init(&t, c->ops);
+    unsigned long found = 0;
+    for(unsigned long i=0; i+NQ<=c->ops; i+=NQ){
+        timer_start(&t);
+        skip_list_quantiles(l, qs, NQ, out);
+        timer_stop_n(&t, NQ);
+        found += out[0] != NULL;
+    }
+    timer_report(c, "quantiles", &t);
+    for(unsigned long i=0; i+NQ<=c->ops; i+=NQ){
+        for(int j=0; j<NQ; j++){
+            timer_start(&t);
+            out[j] = skip_list_get_node_by_rank(l, ranks[j]);
+            timer_stop(&t);
+        }
+        found += out[0] != NULL;
+    }
+    timer_report(c, "get_node_by_rank", &t);
+    if(found == (unsigned long)-1){
+        printf("\n"); //不让编译器优化掉结果
+    }
+    free(t.lat);
+    free(keys);
+    skip_list_destroy(l);
+}
+
+
+//区间聚合: 每次查询的范围大约有n/10个节点, 查询ops/1000次. 分别用和不用-DSKIPLIST_AGGREGATE编译对比
+static void case_aggregate(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_list_t *l = case_list(c, keys, NULL);
+    bench_timer_t t;
+    timer_init(&t, c->ops / 1000);
+    uint64_t rng = c->seed;
+    uint64_t total = 0;
+    skip_agg_t agg;
+    for(unsigned long i=0; i<c->ops/1000; i++){
+        uint32_t lo = (uint32_t)(rng_next(&rng) % (2 * c->n + 1));
+        timer_start(&t);
+        skip_list_aggregate_range(l, (element_t)lo, (element_t)(uint32_t)(lo + c->n / 5), &agg);
+        timer_stop(&t);
+        total += agg.sum.u64;
+    }
+    timer_report(c, "aggregate_range", &t);
+    if(total == (uint64_t)-1){
+        printf("\n"); //不让编译器优化掉结果
+    }
+    free(t.lat);
+    free(keys);
+    skip_list_destroy(l);
+}
+
+
+//定时器队列: 弹出所有节点, 对比remove_node(第一个节点), pop_min和每次弹出1000个的pop_min_n
+static void case_pop(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    element_t *out = calloc(1000, sizeof(*out));
+    bench_timer_t t;
+    timer_init(&t, c->n);
+    unsigned long sum = 0;
+    for(int v=0; v<3; v++){
+        skip_list_t *l = case_list(c, keys, NULL);
+        unsigned long k = 1;
+        while(l->length > 0 && k > 0){
+            timer_start(&t);
+            if(v == 0){
+                skip_list_remove_node(l, l->header->level[0].forward);
+            }else if(v == 1){
+                skip_list_pop_min(l, out, NULL);
+            }else{
+                k = skip_list_pop_min_n(l, 1000, out, NULL);
+            }
+            timer_stop_n(&t, k);
+            sum += out[0].u32;
+        }
+        timer_report(c, v == 0 ? "remove_node" : (v == 1 ? "pop_min" : "pop_min_n(1000)"), &t);
+        skip_list_destroy(l);
+    }
+    if(sum == (unsigned long)-1){
+        printf("\n"); //不让编译器优化掉结果
+    }
+    free(t.lat);
+    free(out);
+    free(keys);
+}
+
+
+#define CASE_BATCH 1024
+
+
+//大量互不相关的key(一半命中): 逐个find对比每次CASE_BATCH个key的find_batch
+static void case_find_batch(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_list_t *l = case_list(c, keys, NULL);
+    uint32_t *probes = malloc((c->ops > 0 ? c->ops : 1) * sizeof(*probes));
+    skip_node_t **nodes = malloc((c->ops > 0 ? c->ops : 1) * sizeof(*nodes));
+    uint64_t rng = c->seed;
+    for(unsigned long i=0; i<c->ops && c->n>0; i++){
+        probes[i] = i % 2 ? keys[rng_next(&rng) % c->n] : (uint32_t)(rng_next(&rng) % (2 * c->n + 1));
+    }
+    bench_timer_t t;
+    timer_init(&t, c->ops);
+    for(unsigned long i=0; i<c->ops; i++){
+        timer_start(&t);
+        nodes[i] = skip_list_find(l, (element_t)probes[i]);
+        timer_stop(&t);
+    }
+    timer_report(c, "find", &t);
+    for(unsigned long i=0; i<c->ops; i+=CASE_BATCH){
+        unsigned long k = c->ops - i < CASE_BATCH ? c->ops - i : CASE_BATCH;
+        timer_start(&t);
+        skip_list_find_batch(l, probes + i, k, nodes + i);
+        timer_stop_n(&t, k);
+    }
+    timer_report(c, "find_batch", &t);
+    free(t.lat);
+    free(nodes);
+    free(probes);
+    free(keys);
+    skip_list_destroy(l);
+}
+
+
+//merge join: 有序的key(均匀分布在整个key范围中)逐个find对比一次seek_sorted
+static void case_seek_sorted(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_list_t *l = case_list(c, keys, NULL);
+    uint32_t *probes = malloc((c->ops > 0 ? c->ops : 1) * sizeof(*probes));
+    skip_node_t **nodes = malloc((c->ops > 0 ? c->ops : 1) * sizeof(*nodes));
+    for(unsigned long i=0; i<c->ops; i++){
+        probes[i] = (uint32_t)((double)i / c->ops * (2 * c->n + 1));
+    }
+    bench_timer_t t;
+    timer_init(&t, c->ops);
+    for(unsigned long i=0; i<c->ops; i++){
+        timer_start(&t);
+        nodes[i] = skip_list_find(l, (element_t)probes[i]);
+        timer_stop(&t);
+    }
+    timer_report(c, "find", &t);
+    if(c->ops > 0){
+        timer_start(&t);
+        skip_list_seek_sorted(l, probes, c->ops, nodes, NULL);
+        timer_stop_n(&t, c->ops);
+    }
+    timer_report(c, "seek_sorted", &t);
+    free(t.lat);
+    free(nodes);
+    free(probes);
+    free(keys);
+    skip_list_destroy(l);
+}
+
+
+//两个n个节点的list(一半的key相同)求并集: 把两个list逐个插入一个新list对比skip_list_union,
+//以及intersect/difference/merge. 整体操作的时间平均到两个list的节点上
+static void case_set_ops(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_list_t *a = case_list(c, keys, NULL);
+    for(unsigned long i=0; i<c->n; i++){
+        keys[i] += i % 2;
+    }
+    skip_list_t *b = case_list(c, keys, NULL);
+    bench_timer_t t;
+    timer_init(&t, 2 * c->n);
+    skip_list_t *u = skip_list_create(TUINT32, TUINT32, compare_func_list[TUINT32], c->flags);
+    skip_node_t *node;
+    for(int v=0; v<2; v++){
+        skip_list_foreach(node, v == 0 ? a : b){
+            timer_start(&t);
+            skip_list_insert(u, node->key, node->value);
+            timer_stop(&t);
+        }
+    }
+    timer_report(c, "insert", &t);
+    skip_list_destroy(u);
+    static const char * const names[] = {"union", "intersect", "difference", "merge"};
+    for(int v=0; v<4 && c->n>0; v++){
+        timer_start(&t);
+        u = v == 0 ? skip_list_union(a, b, false) : (v == 1 ? skip_list_intersect(a, b, false) :
+                (v == 2 ? skip_list_difference(a, b, false) : skip_list_merge(a, b)));
+        timer_stop_n(&t, 2 * c->n);
+        timer_report(c, names[v], &t);
+        skip_list_destroy(u);
+    }
+    free(t.lat);
+    free(keys);
+    skip_list_destroy(a);
+    skip_list_destroy(b);
+}
+
+
+//把list的后一半移到另一个list再移回来(例如迁移分片): 逐个remove+insert对比split+concat, 时间平均到移动的节点上
+static void case_split_concat(const bench_config_t *c){
+    uint32_t *keys = case_keys(c);
+    skip_list_t *l = case_list(c, keys, NULL);
+    skip_list_t *other = skip_list_create(TUINT32, TUINT32, compare_func_list[TUINT32], c->flags);
+    //seq分布的key是0到n-1, 其他分布是[0, 2n)中的奇数
+    uint32_t mid = c->dist == DIST_SEQ ? (uint32_t)(c->n / 2) : (uint32_t)c->n;
+    bench_timer_t t;
+    timer_init(&t, 2 * c->n);
+    for(int v=0; v<2; v++){
+        for(unsigned long i=0; i<c->n; i++){
+            if(keys[i] < mid){
+                continue;
+            }
+            timer_start(&t);
+            skip_list_remove(v == 0 ? l : other, (element_t)keys[i]);
+            skip_list_insert(v == 0 ? other : l, (element_t)keys[i], (element_t)(uint32_t)i);
+            timer_stop(&t);
+        }
+    }
+    timer_report(c, "remove+insert", &t);
+    skip_list_destroy(other);
+    timer_start(&t);
+    other = skip_list_split_at_key(l, (element_t)mid);
+    unsigned long moved = other->length > 0 ? other->length : 1;
+    timer_stop_n(&t, moved);
+    timer_start(&t);
+    skip_list_concat(l, other);
+    timer_stop_n(&t, moved);
+    timer_report(c, "split+concat", &t);
+    free(t.lat);
+    free(keys);
+    skip_list_destroy(other);
+    skip_list_destroy(l);
+}
+
+
+static const struct {
+    const char *name;
+    void (*run)(const bench_config_t *c);
+} bench_cases[] = {
+    {"node_handle", case_node_handle},
+    {"skiplist32", case_skiplist32},
+    {"update_key", case_update_key},
+    {"quantiles", case_quantiles},
+    {"aggregate", case_aggregate},
+    {"pop", case_pop},
+    {"find_batch", case_find_batch},
+    {"seek_sorted", case_seek_sorted},
+    {"set_ops", case_set_ops},
+    {"split_concat", case_split_concat},
+};
+
+
+static bool parse_mix(const char *s, unsigned int *mix){
+    return sscanf(s, "%u:%u:%u:%u:%u", &mix[0], &mix[1], &mix[2], &mix[3], &mix[4]) == OP_COUNT;
+}
+
+
+int main(int argc, char **argv){
+    bench_config_t c = {TUINT32, DIST_UNIFORM, 100000, 1000000, {90, 5, 5, 0, 0}, SKIP_LIST_ARENA, 1};
+    bool single = false;
+    void (*run_case)(const bench_config_t *c) = NULL;
+    for(int i=1; i<argc; i++){
+        char *arg = argv[i];
+        char *value = strchr(arg, '=');
+        if(value == NULL){
+            fprintf(stderr, "bad argument %s\n", arg);
+            return 1;
+        }
+        value++;
+        single = true;
+        if(strncmp(arg, "--type=", 7) == 0){
+            c.type = TUNKNOW;
+            for(size_t t=0; t<sizeof(bench_types)/sizeof(bench_types[0]); t++){
+                if(strcmp(value, element_typename_list[bench_types[t]]) == 0 || (strcmp(value, "str") == 0 && bench_types[t] == TSTR)){
+                    c.type = bench_types[t];
+                }
+            }
+        }else if(strncmp(arg, "--dist=", 7) == 0){
+            c.dist = -1;
+            for(int d=0; d<DIST_COUNT; d++){
+                if(strcmp(value, dist_names[d]) == 0){
+                    c.dist = d;
+                }
+            }
+        }else if(strncmp(arg, "--n=", 4) == 0){
+            c.n = strtoul(value, NULL, 10);
+        }else if(strncmp(arg, "--ops=", 6) == 0){
+            c.ops = strtoul(value, NULL, 10);
+        }else if(strncmp(arg, "--mix=", 6) == 0){
+            if(!parse_mix(value, c.mix)){
+                fprintf(stderr, "bad mix %s\n", value);
+                return 1;
+            }
+        }else if(strncmp(arg, "--flags=", 8) == 0){
+            c.flags = 0;
+            if(strstr(value, "arena")) c.flags |= SKIP_LIST_ARENA;
+            if(strstr(value, "prefix")) c.flags |= SKIP_LIST_KEY_PREFIX;
+            if(strstr(value, "prefetch")) c.flags |= SKIP_LIST_PREFETCH;
+        }else if(strncmp(arg, "--seed=", 7) == 0){
+            c.seed = strtoull(value, NULL, 10);
+        }else if(strncmp(arg, "--case=", 7) == 0){
+            for(size_t k=0; k<sizeof(bench_cases)/sizeof(bench_cases[0]); k++){
+                if(strcmp(value, bench_cases[k].name) == 0){
+                    run_case = bench_cases[k].run;
+                }
+            }
+            if(run_case == NULL){
+                fprintf(stderr, "bad case %s\n", value);
+                return 1;
+            }
+        }else{
+            fprintf(stderr, "bad argument %s\n", arg);
+            return 1;
+        }
+    }
+    if(c.type == TUNKNOW || c.dist < 0){
+        fprintf(stderr, "bad type or dist\n");
+        return 1;
+    }
+
+    printf("phase,type,dist,flags,n,ops,mix,mops,ns_op,p50_ns,p99_ns,p999_ns,max_rss_kb\n");
+    if(run_case != NULL){
+        c.type = TUINT32;
+        run_case(&c);
+        return 0;
+    }
+    if(single){
+        bench_run(&c);
+        return 0;
+    }
+
+    static const unsigned int mixes[][OP_COUNT] = {
+        {90, 5, 5, 0, 0}, //读多写少
+        {20, 40, 40, 0, 0}, //写多
+        {50, 0, 0, 50, 0}, //排名
+        {50, 0, 0, 0, 50}, //范围
+    };
+    for(size_t t=0; t<sizeof(bench_types)/sizeof(bench_types[0]); t++){
+        for(int d=0; d<DIST_COUNT; d++){
+            for(size_t m=0; m<sizeof(mixes)/sizeof(mixes[0]); m++){
+                c.type = bench_types[t];
+                c.dist = d;
+                memcpy(c.mix, mixes[m], sizeof(c.mix));
+                bench_run(&c);
+            }
+        }
+    }
+    return 0;
+}
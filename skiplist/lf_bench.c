@@ -0,0 +1,149 @@
+/*
+比较lf_skiplist, 按key范围分片的sharded_skiplist和加了一把互斥锁的skiplist在多线程下的吞吐量.
+用法: ./lf_bench [最大线程数] [key范围] [每个线程的操作数] [find所占的百分比]
+*/
+
+#define NDEBUG
+
+#include "skiplist.h"
+#include "lf_skiplist.h"
+#include "sharded_skiplist.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+static int key_range = 1000000;
+static int ops_per_thread = 1000000;
+static unsigned int find_percent = 90;
+
+static lf_skip_list_t *lf_list;
+static sharded_skip_list_t *sharded_list;
+static skip_list_t *locked_list;
+static pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static inline uint32_t bench_rand(uint64_t *seed){
+    uint64_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *seed = x;
+    return (uint32_t)(x >> 16);
+}
+
+
+static void *lf_worker(void *arg){
+    uint64_t seed = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+    for(int i=0; i<ops_per_thread; i++){
+        uint32_t r = bench_rand(&seed);
+        uint32_t key = r % key_range;
+        uint32_t op = (r >> 20) % 100;
+        if(op < find_percent){
+            LF_SKIP_LIST_FIND(lf_list, key, NULL);
+        }else if(op % 2 == 0){
+            LF_SKIP_LIST_INSERT(lf_list, key, key);
+        }else{
+            LF_SKIP_LIST_REMOVE(lf_list, key);
+        }
+    }
+    lf_skip_list_thread_exit();
+    return NULL;
+}
+
+
+static void *sharded_worker(void *arg){
+    uint64_t seed = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+    for(int i=0; i<ops_per_thread; i++){
+        uint32_t r = bench_rand(&seed);
+        uint32_t key = r % key_range;
+        uint32_t op = (r >> 20) % 100;
+        if(op < find_percent){
+            SHARDED_SKIP_LIST_FIND(sharded_list, key, NULL);
+        }else if(op % 2 == 0){
+            SHARDED_SKIP_LIST_INSERT(sharded_list, key, key);
+        }else{
+            SHARDED_SKIP_LIST_REMOVE(sharded_list, key);
+        }
+    }
+    return NULL;
+}
+
+
+static void *locked_worker(void *arg){
+    uint64_t seed = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+    for(int i=0; i<ops_per_thread; i++){
+        uint32_t r = bench_rand(&seed);
+        uint32_t key = r % key_range;
+        uint32_t op = (r >> 20) % 100;
+        pthread_mutex_lock(&list_lock);
+        if(op < find_percent){
+            SKIP_LIST_FIND(locked_list, key);
+        }else if(op % 2 == 0){
+            SKIP_LIST_INSERT(locked_list, key, key);
+        }else{
+            SKIP_LIST_REMOVE(locked_list, key);
+        }
+        pthread_mutex_unlock(&list_lock);
+    }
+    return NULL;
+}
+
+
+static double run(int threads, void *(*worker)(void *)){
+    pthread_t tids[threads];
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for(int i=0; i<threads; i++){
+        pthread_create(&tids[i], NULL, worker, (void *)(uintptr_t)(i+1));
+    }
+    for(int i=0; i<threads; i++){
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    return (double)threads * ops_per_thread / seconds / 1e6;
+}
+
+
+int main(int argc, char **argv){
+    int max_threads = argc > 1? atoi(argv[1]): 8;
+    if(argc > 2) key_range = atoi(argv[2]);
+    if(argc > 3) ops_per_thread = atoi(argv[3]);
+    if(argc > 4){
+        int percent = atoi(argv[4]);
+        if(percent < 0 || percent > 100){
+            fprintf(stderr, "find percent must be in [0, 100]\n");
+            return 1;
+        }
+        find_percent = (unsigned int)percent;
+    }
+
+    printf("key range %d, %d ops/thread, %u%% find\n", key_range, ops_per_thread, find_percent);
+    printf("threads,lf_mops,sharded_mops,locked_mops\n");
+    for(int threads=1; threads<=max_threads; threads*=2){
+        //预先插入一半的key, 插入和删除的比例相同, list的大小基本保持不变
+        lf_list = LF_SKIP_LIST_CREATE(uint32_t, uint32_t);
+        sharded_list = SHARDED_SKIP_LIST_CREATE(uint32_t, uint32_t, 64);
+        locked_list = SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA);
+        for(uint32_t key=0; key<(uint32_t)key_range; key+=2){
+            LF_SKIP_LIST_INSERT(lf_list, key, key);
+            SHARDED_SKIP_LIST_INSERT(sharded_list, key, key);
+            SKIP_LIST_INSERT(locked_list, key, key);
+        }
+        lf_skip_list_thread_exit();
+
+        double lf = run(threads, lf_worker);
+        double sharded = run(threads, sharded_worker);
+        double locked = run(threads, locked_worker);
+        printf("%d,%.2f,%.2f,%.2f\n", threads, lf, sharded, locked);
+
+        LF_SKIP_LIST_DESTROY(lf_list);
+        lf_skip_list_reclaim();
+        SHARDED_SKIP_LIST_DESTROY(sharded_list);
+        SKIP_LIST_DESTROY(locked_list);
+    }
+    return 0;
+}
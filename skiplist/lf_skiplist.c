@@ -0,0 +1,361 @@
+/*
+无锁的并发skiplist, 参考Herlihy & Shavit的LockFreeSkipList, 使用epoch回收内存.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "lf_skiplist.h"
+
+
+#define LF_MARK ((uintptr_t)1)
+#define LF_PTR(x) ((lf_skip_node_t *)((x) & ~LF_MARK))
+#define LF_MARKED(x) ((x) & LF_MARK)
+
+#define LF_EPOCH_BAGS 3
+#define LF_EPOCH_FREQ 64 //每进入多少次临界区尝试推进一次全局epoch
+
+
+/*
+epoch回收: 每个线程有一个记录, 进入临界区时记下当前的全局epoch.
+只有所有在临界区中的线程都看到了全局epoch e, 全局epoch才能推进到e+1.
+节点从list中摘下来之后记下当时的全局epoch r, 等全局epoch到达r+2时,
+所有可能持有它的线程(进入临界区时epoch不大于r)都已经离开, 这时才真正释放.
+*/
+typedef struct lf_epoch_record lf_epoch_record_t;
+
+struct lf_epoch_record {
+    atomic_ulong epoch;
+    atomic_bool active; //是否在临界区中
+    atomic_bool in_use; //是否有线程在使用这个记录
+    lf_epoch_record_t *next; //加入全局链表之后不再修改
+
+    unsigned long ops;
+    uint64_t seed; //random_level使用的随机数状态, rand()不是线程安全的
+    lf_skip_node_t *bag[LF_EPOCH_BAGS]; //等待回收的节点
+    unsigned long bag_epoch[LF_EPOCH_BAGS];
+};
+
+
+static atomic_ulong global_epoch = 0;
+static _Atomic(lf_epoch_record_t *) epoch_records = NULL;
+static _Thread_local lf_epoch_record_t *local_record = NULL;
+
+
+static lf_epoch_record_t *lf_epoch_record(void){
+    if(local_record != NULL){
+        return local_record;
+    }
+    lf_epoch_record_t *r;
+    for(r = atomic_load(&epoch_records); r != NULL; r = r->next){
+        bool expected = false;
+        if(!atomic_load(&r->in_use) && atomic_compare_exchange_strong(&r->in_use, &expected, true)){
+            local_record = r;
+            return r;
+        }
+    }
+    r = calloc(1, sizeof(*r));
+    atomic_store(&r->in_use, true);
+    r->seed = (uint64_t)(uintptr_t)r ^ ((uint64_t)time(NULL) << 32) ^ 0x9e3779b97f4a7c15ULL;
+    lf_epoch_record_t *head = atomic_load(&epoch_records);
+    do{
+        r->next = head;
+    }while(!atomic_compare_exchange_weak(&epoch_records, &head, r));
+    local_record = r;
+    return r;
+}
+
+
+static void lf_epoch_free_bag(lf_epoch_record_t *r, int b){
+    lf_skip_node_t *node = r->bag[b];
+    while(node != NULL){
+        lf_skip_node_t *next = node->retire_next;
+        free(node);
+        node = next;
+    }
+    r->bag[b] = NULL;
+}
+
+
+static void lf_epoch_try_advance(void){
+    unsigned long e = atomic_load(&global_epoch);
+    for(lf_epoch_record_t *r = atomic_load(&epoch_records); r != NULL; r = r->next){
+        if(atomic_load(&r->active) && atomic_load(&r->epoch) != e){
+            return;
+        }
+    }
+    atomic_compare_exchange_strong(&global_epoch, &e, e+1);
+}
+
+
+void lf_skip_list_reclaim(void){
+    for(lf_epoch_record_t *r = atomic_load(&epoch_records); r != NULL; r = r->next){
+        for(int b=0; b<LF_EPOCH_BAGS; b++){
+            lf_epoch_free_bag(r, b);
+        }
+    }
+}
+
+
+static lf_epoch_record_t *lf_epoch_enter(void){
+    lf_epoch_record_t *r = lf_epoch_record();
+    atomic_store(&r->active, true);
+    unsigned long e = atomic_load(&global_epoch);
+    atomic_store(&r->epoch, e);
+    if(++r->ops % LF_EPOCH_FREQ == 0){
+        lf_epoch_try_advance();
+    }
+    for(int b=0; b<LF_EPOCH_BAGS; b++){
+        if(r->bag[b] != NULL && r->bag_epoch[b] + 2 <= e){
+            lf_epoch_free_bag(r, b);
+        }
+    }
+    return r;
+}
+
+
+static void lf_epoch_exit(lf_epoch_record_t *r){
+    atomic_store_explicit(&r->active, false, memory_order_release);
+}
+
+
+//节点已经从所有层摘下来之后调用
+static void lf_epoch_retire(lf_epoch_record_t *r, lf_skip_node_t *node){
+    unsigned long e = atomic_load(&global_epoch);
+    int b = e % LF_EPOCH_BAGS;
+    if(r->bag_epoch[b] != e){
+        //原来的节点是e-3或者更早摘下来的, 已经可以释放
+        lf_epoch_free_bag(r, b);
+        r->bag_epoch[b] = e;
+    }
+    node->retire_next = r->bag[b];
+    r->bag[b] = node;
+}
+
+
+void lf_skip_list_thread_exit(void){
+    lf_epoch_record_t *r = local_record;
+    if(r == NULL){
+        return;
+    }
+    atomic_store(&r->active, false);
+    atomic_store(&r->in_use, false);
+    local_record = NULL;
+}
+
+
+static int lf_random_level(lf_epoch_record_t *r){
+    uint64_t x = r->seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    r->seed = x;
+    int level = 1;
+    //每两位决定是否再加一层, P = 1/4
+    while((x & 3) == 0 && level < SKIPLIST_MAXLEVEL){
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+
+static lf_skip_node_t *lf_skip_node_create(int level, element_t key, element_t value){
+    lf_skip_node_t *node = malloc(sizeof(*node) + level*sizeof(node->forward[0]));
+    node->key = key;
+    node->value = value;
+    node->retire_next = NULL;
+    atomic_init(&node->refs, 2);
+    node->level = level;
+    return node;
+}
+
+
+lf_skip_list_t *lf_skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare){
+    lf_skip_list_t *l = malloc(sizeof(*l));
+    l->header = lf_skip_node_create(SKIPLIST_MAXLEVEL, (element_t)0, (element_t)0);
+    for(int i=0; i<SKIPLIST_MAXLEVEL; i++){
+        atomic_init(&l->header->forward[i], 0);
+    }
+    atomic_init(&l->level, 1);
+    atomic_init(&l->length, 0);
+    l->key_type = key_typeid;
+    l->value_type = value_typeid;
+    l->compare = compare;
+    return l;
+}
+
+
+void lf_skip_list_destroy(lf_skip_list_t *l){
+    lf_skip_node_t *cur = LF_PTR(atomic_load(&l->header->forward[0]));
+    while(cur != NULL){
+        lf_skip_node_t *next = LF_PTR(atomic_load(&cur->forward[0]));
+        free(cur);
+        cur = next;
+    }
+    free(l->header);
+    free(l);
+}
+
+
+/*
+查找key在每一层的前驱和后继, 顺便把遇到的已经标记删除的节点摘下来.
+摘节点的CAS失败说明前驱被修改了, 从头开始重新查找.
+*/
+static bool lf_skip_list_search(lf_skip_list_t *l, element_t key, lf_skip_node_t **preds, lf_skip_node_t **succs){
+retry:;
+    lf_skip_node_t *pred = l->header;
+    for(int i=atomic_load(&l->level)-1; i>=0; i--){
+        lf_skip_node_t *cur = LF_PTR(atomic_load(&pred->forward[i]));
+        while(cur != NULL){
+            uintptr_t succ = atomic_load(&cur->forward[i]);
+            while(LF_MARKED(succ)){
+                uintptr_t expected = (uintptr_t)cur;
+                if(!atomic_compare_exchange_strong(&pred->forward[i], &expected, succ & ~LF_MARK)){
+                    goto retry;
+                }
+                cur = LF_PTR(succ);
+                if(cur == NULL){
+                    break;
+                }
+                succ = atomic_load(&cur->forward[i]);
+            }
+            if(cur == NULL || l->compare(cur->key, key) >= 0){
+                break;
+            }
+            pred = cur;
+            cur = LF_PTR(succ);
+        }
+        preds[i] = pred;
+        succs[i] = cur;
+    }
+    return succs[0] != NULL && l->compare(succs[0]->key, key) == 0;
+}
+
+
+static void lf_skip_node_release(lf_epoch_record_t *r, lf_skip_node_t *node){
+    if(atomic_fetch_sub(&node->refs, 1) == 1){
+        lf_epoch_retire(r, node);
+    }
+}
+
+
+bool lf_skip_list_insert(lf_skip_list_t *l, element_t key, element_t value){
+    lf_skip_node_t *preds[SKIPLIST_MAXLEVEL];
+    lf_skip_node_t *succs[SKIPLIST_MAXLEVEL];
+    lf_epoch_record_t *r = lf_epoch_enter();
+    int level = lf_random_level(r);
+    int top = atomic_load(&l->level);
+    while(top < level && !atomic_compare_exchange_weak(&l->level, &top, level));
+
+    lf_skip_node_t *node = NULL;
+    while(true){
+        if(lf_skip_list_search(l, key, preds, succs)){
+            lf_epoch_exit(r);
+            free(node); //还没有被其他线程看到, 可以直接释放
+            return false;
+        }
+        if(node == NULL){
+            node = lf_skip_node_create(level, key, value);
+        }
+        for(int i=0; i<level; i++){
+            atomic_store_explicit(&node->forward[i], (uintptr_t)succs[i], memory_order_relaxed);
+        }
+        uintptr_t expected = (uintptr_t)succs[0];
+        if(atomic_compare_exchange_strong(&preds[0]->forward[0], &expected, (uintptr_t)node)){
+            break;
+        }
+    }
+    atomic_fetch_add(&l->length, 1);
+
+    //第0层链接成功后节点就已经在list中了, 再逐层链接上面的层
+    for(int i=1; i<level; i++){
+        while(true){
+            uintptr_t old = atomic_load(&node->forward[i]);
+            if(LF_MARKED(old)){
+                goto done;
+            }
+            if(old != (uintptr_t)succs[i] && !atomic_compare_exchange_strong(&node->forward[i], &old, (uintptr_t)succs[i])){
+                goto done; //CAS失败只可能是被删除线程打上了标记
+            }
+            uintptr_t expected = (uintptr_t)succs[i];
+            if(atomic_compare_exchange_strong(&preds[i]->forward[i], &expected, (uintptr_t)node)){
+                break;
+            }
+            lf_skip_list_search(l, key, preds, succs);
+            if(succs[0] != node){
+                goto done;
+            }
+        }
+    }
+done:
+    //链接的过程中节点可能已经被删除了, 这时刚链接上的层需要再摘下来
+    if(LF_MARKED(atomic_load(&node->forward[0]))){
+        lf_skip_list_search(l, key, preds, succs);
+    }
+    lf_skip_node_release(r, node);
+    lf_epoch_exit(r);
+    return true;
+}
+
+
+bool lf_skip_list_find(lf_skip_list_t *l, element_t key, element_t *value){
+    lf_epoch_record_t *r = lf_epoch_enter();
+    lf_skip_node_t *pred = l->header;
+    lf_skip_node_t *cur = NULL;
+    for(int i=atomic_load(&l->level)-1; i>=0; i--){
+        cur = LF_PTR(atomic_load(&pred->forward[i]));
+        while(cur != NULL){
+            uintptr_t succ = atomic_load(&cur->forward[i]);
+            //跳过已经标记删除的节点, 不帮助摘除, 所以不会因为其他线程的修改而重试
+            while(LF_MARKED(succ)){
+                cur = LF_PTR(succ);
+                if(cur == NULL){
+                    break;
+                }
+                succ = atomic_load(&cur->forward[i]);
+            }
+            if(cur == NULL || l->compare(cur->key, key) >= 0){
+                break;
+            }
+            pred = cur;
+            cur = LF_PTR(succ);
+        }
+    }
+    bool found = cur != NULL && l->compare(cur->key, key) == 0 && !LF_MARKED(atomic_load(&cur->forward[0]));
+    if(found && value != NULL){
+        *value = cur->value;
+    }
+    lf_epoch_exit(r);
+    return found;
+}
+
+
+bool lf_skip_list_remove(lf_skip_list_t *l, element_t key){
+    lf_skip_node_t *preds[SKIPLIST_MAXLEVEL];
+    lf_skip_node_t *succs[SKIPLIST_MAXLEVEL];
+    lf_epoch_record_t *r = lf_epoch_enter();
+    if(!lf_skip_list_search(l, key, preds, succs)){
+        lf_epoch_exit(r);
+        return false;
+    }
+    lf_skip_node_t *victim = succs[0];
+    for(int i=victim->level-1; i>=1; i--){
+        uintptr_t succ = atomic_load(&victim->forward[i]);
+        while(!LF_MARKED(succ) && !atomic_compare_exchange_weak(&victim->forward[i], &succ, succ | LF_MARK));
+    }
+    //第0层打上标记的线程才算删除成功
+    uintptr_t succ = atomic_load(&victim->forward[0]);
+    while(!LF_MARKED(succ)){
+        if(atomic_compare_exchange_strong(&victim->forward[0], &succ, succ | LF_MARK)){
+            lf_skip_list_search(l, key, preds, succs);
+            atomic_fetch_sub(&l->length, 1);
+            lf_skip_node_release(r, victim);
+            lf_epoch_exit(r);
+            return true;
+        }
+    }
+    lf_epoch_exit(r);
+    return false;
+}
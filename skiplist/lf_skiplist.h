@@ -0,0 +1,141 @@
+#ifndef LF_SKIPLIST_H
+#define LF_SKIPLIST_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "skiplist.h"
+
+/*
+无锁的并发skiplist, 语义和skip_list_insert/skip_list_find/skip_list_remove一致(key不能重复).
+find不做任何写操作, 是wait-free的; insert/remove通过CAS修改forward指针, 是lock-free的.
+删除时先在指针的最低位打上删除标记, 再把节点从每一层摘下来.
+节点的回收使用epoch: 被删除的节点要等到所有可能持有它的线程都离开临界区之后才真正释放.
+不支持排名, length只是一个近似值.
+*/
+
+typedef struct lf_skip_node lf_skip_node_t;
+typedef struct lf_skip_list lf_skip_list_t;
+
+
+struct lf_skip_node {
+    element_t key;
+    element_t value;
+    lf_skip_node_t *retire_next; //等待回收时串在线程的回收链表上
+    atomic_int refs; //插入线程和删除线程各持有一个引用, 都放弃之后节点才进入回收流程
+    int level;
+    _Atomic(uintptr_t) forward[]; //最低位为1表示这个节点已经被删除
+};
+
+
+struct lf_skip_list {
+    lf_skip_node_t *header; //forward为0表示链表结束
+    atomic_int level; //出现过的最大层数, 查找从这里开始
+    atomic_ulong length;
+
+    element_type_t key_type;
+    element_type_t value_type;
+
+    compare_func_t compare;
+};
+
+
+lf_skip_list_t *lf_skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare);
+
+
+#define LF_SKIP_LIST_CREATE(KEY_TYPE, VALUE_TYPE) ({ \
+    KEY_TYPE __key__; \
+    VALUE_TYPE __value__; \
+    (void) __key__; \
+    (void) __value__; \
+    element_type_t __key_type__ = ELEMENT_TYPEID(__key__); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(__value__); \
+    if(__key_type__ > TSTR){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ > TDOUBLE){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    lf_skip_list_create(__key_type__, __value_type__, compare_func_list[__key_type__]); \
+})
+
+
+#ifndef NDEBUG
+
+#define LF_SKIP_LIST_INSERT(list, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    lf_skip_list_insert((list), (element_t)(key), (element_t)(value)); \
+})
+
+
+#define LF_SKIP_LIST_FIND(list, key, value_ptr) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    lf_skip_list_find((list), (element_t)(key), (value_ptr)); \
+})
+
+
+#define LF_SKIP_LIST_REMOVE(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    lf_skip_list_remove((list), (element_t)(key)); \
+})
+
+#else
+
+#define LF_SKIP_LIST_INSERT(list, key, value) (lf_skip_list_insert((list), (element_t)(key), (element_t)(value)))
+
+
+#define LF_SKIP_LIST_FIND(list, key, value_ptr) (lf_skip_list_find((list), (element_t)(key), (value_ptr)))
+
+
+#define LF_SKIP_LIST_REMOVE(list, key) (lf_skip_list_remove((list), (element_t)(key)))
+
+#endif //NDEBUG
+
+
+#define LF_SKIP_LIST_DESTROY(list) do{ lf_skip_list_destroy((list)); (list)=NULL; } while(0)
+
+
+//destroy时不能有其他线程还在访问这个list. 只释放还在list中的节点, 已经删除等待回收的节点由lf_skip_list_reclaim释放
+void lf_skip_list_destroy(lf_skip_list_t *l);
+
+
+//key已经存在时返回false
+bool lf_skip_list_insert(lf_skip_list_t *l, element_t key, element_t value);
+
+
+//找到时把value复制到*value(可以为NULL)并返回true. 节点可能随时被其他线程删除, 所以不返回节点指针.
+bool lf_skip_list_find(lf_skip_list_t *l, element_t key, element_t *value);
+
+
+bool lf_skip_list_remove(lf_skip_list_t *l, element_t key);
+
+
+//线程退出前调用, 把本线程的epoch记录交给以后的线程复用, 没有释放的节点也会由它们释放
+void lf_skip_list_thread_exit(void);
+
+
+//释放所有线程中等待回收的节点(epoch记录是所有list共用的). 调用时不能有其他线程在访问任何lf_skip_list
+void lf_skip_list_reclaim(void);
+
+
+#endif //ifndef LF_SKIPLIST_H
@@ -0,0 +1,452 @@
+/*
+按key范围分片的并发skiplist, 每个shard一把锁, 边界用split/concat自动调整.
+*/
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "sharded_skiplist.h"
+
+
+#define SHARDED_SPLIT_MIN 4096 //shard至少有这么多节点才会split
+#define SHARDED_DIRTY_BITS (8*sizeof(unsigned long))
+
+
+static inline element_t sharded_bound(sharded_skip_list_t *l, int i){
+    element_t key;
+    key.u64 = atomic_load_explicit(&l->bounds[i], memory_order_relaxed);
+    return key;
+}
+
+
+static inline sharded_shard_t *sharded_at(sharded_skip_list_t *l, int i){
+    return atomic_load_explicit(&l->shards[i], memory_order_relaxed);
+}
+
+
+/*
+Fenwick树: fenwick[i]是位置(i - lowbit(i), i]之间的shard的长度之和, 修改和求前缀和都是O(log shard数).
+只在l->lock下访问.
+*/
+static void sharded_fenwick_add(sharded_skip_list_t *l, int pos, unsigned long delta){
+    int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+    for(int i=pos+1; i<=n; i+=i&-i){
+        l->fenwick[i] += delta;
+    }
+}
+
+
+//前pos个shard的长度之和
+static unsigned long sharded_fenwick_prefix(sharded_skip_list_t *l, int pos){
+    unsigned long sum = 0;
+    for(int i=pos; i>0; i-=i&-i){
+        sum += l->fenwick[i];
+    }
+    return sum;
+}
+
+
+//全局排名rank所在的shard的位置, *before是它前面的shard的长度之和. rank超出范围时返回nshards
+static int sharded_fenwick_find(sharded_skip_list_t *l, unsigned long rank, unsigned long *before){
+    int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+    int pos = 0;
+    unsigned long sum = 0;
+    for(int step=1<<(31-__builtin_clz(n)); step>0; step>>=1){
+        if(pos+step <= n && sum + l->fenwick[pos+step] < rank){
+            pos += step;
+            sum += l->fenwick[pos];
+        }
+    }
+    *before = sum;
+    return pos;
+}
+
+
+//shard的顺序或者长度整体变化之后重新建立Fenwick树, O(shard数)
+static void sharded_fenwick_build(sharded_skip_list_t *l){
+    int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+    for(int i=1; i<=n; i++){
+        l->fenwick[i] = sharded_at(l, i-1)->counted;
+    }
+    for(int i=1; i<=n; i++){
+        int j = i + (i&-i);
+        if(j <= n){
+            l->fenwick[j] += l->fenwick[i];
+        }
+    }
+}
+
+
+/*
+写入之后在shard的锁下调用: 更新长度的副本, 没有脏标记时打上标记.
+先写长度再读标记, 和sharded_flush的先清标记再读长度配对(都是seq_cst), 不会漏掉更新.
+标记已经存在时只读不写, 多个shard共用的位图不会在每次写入时都被修改.
+*/
+static void sharded_mark(sharded_skip_list_t *l, sharded_shard_t *s){
+    atomic_store(&s->length, s->list->length);
+    atomic_ulong *word = &l->dirty[s->id / SHARDED_DIRTY_BITS];
+    unsigned long bit = 1UL << (s->id % SHARDED_DIRTY_BITS);
+    if(!(atomic_load(word) & bit)){
+        atomic_fetch_or(word, bit);
+    }
+}
+
+
+//在l->lock下把有脏标记的shard的长度计入Fenwick树
+static void sharded_flush(sharded_skip_list_t *l){
+    for(int w=0; w<(l->max_shards+(int)SHARDED_DIRTY_BITS-1)/(int)SHARDED_DIRTY_BITS; w++){
+        unsigned long bits = atomic_exchange(&l->dirty[w], 0);
+        for(; bits!=0; bits&=bits-1){
+            sharded_shard_t *s = &l->pool[w*SHARDED_DIRTY_BITS + __builtin_ctzl(bits)];
+            unsigned long length = atomic_load(&s->length);
+            if(s->index >= 0){
+                sharded_fenwick_add(l, s->index, length - s->counted);
+            }
+            s->counted = length;
+        }
+    }
+}
+
+
+/*
+找到key所在的shard并锁住它. 先读seq, 按边界二分查找, 锁住shard之后seq没有变化, 说明这期间没有调整过边界,
+找到的shard就是对的; 调整边界的线程先锁住相关的shard再修改seq, 所以锁住之后不会再被移走.
+*/
+static sharded_shard_t *sharded_lock_key(sharded_skip_list_t *l, element_t key){
+    for(;;){
+        unsigned long seq = atomic_load_explicit(&l->seq, memory_order_acquire);
+        if(seq & 1){
+            sched_yield();
+            continue;
+        }
+        int lo = 0;
+        int hi = atomic_load_explicit(&l->nshards, memory_order_relaxed) - 1;
+        while(lo < hi){
+            int mid = (lo + hi + 1) / 2;
+            if(l->compare(sharded_bound(l, mid), key) <= 0){
+                lo = mid;
+            }else{
+                hi = mid - 1;
+            }
+        }
+        sharded_shard_t *s = sharded_at(l, lo);
+        pthread_mutex_lock(&s->lock);
+        //前面读nshards/bounds/shards都是relaxed, 没有锁住的shard也会被移动, 要用acquire fence保证它们在第二次读seq之前完成
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&l->seq, memory_order_relaxed) == seq){
+            return s;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+
+//按当前的长度设置shard下一次尝试调整的上下限: 调整失败时至少再增长/减少一部分才会再次尝试
+static void sharded_set_limits(sharded_skip_list_t *l, sharded_shard_t *s){
+    unsigned long length = s->list->length;
+    s->limit = length + length/4 > l->threshold ? length + length/4 : l->threshold;
+    s->low = length/2 < l->threshold/8 ? length/2 : l->threshold/8;
+}
+
+
+//同时锁住两个shard时按地址顺序加锁
+static void sharded_lock_pair(sharded_shard_t *a, sharded_shard_t *b){
+    pthread_mutex_lock(a < b ? &a->lock : &b->lock);
+    pthread_mutex_lock(a < b ? &b->lock : &a->lock);
+}
+
+
+static inline void sharded_seq_begin(sharded_skip_list_t *l){
+    atomic_fetch_add(&l->seq, 1);
+    atomic_thread_fence(memory_order_release);
+}
+
+
+static inline void sharded_seq_end(sharded_skip_list_t *l){
+    atomic_fetch_add_explicit(&l->seq, 1, memory_order_release);
+}
+
+
+//把位置i+1的shard合并到位置i, 空出来的shard放回pool. 在l->lock下调用
+static void sharded_merge(sharded_skip_list_t *l, int i){
+    sharded_shard_t *a = sharded_at(l, i);
+    sharded_shard_t *b = sharded_at(l, i+1);
+    sharded_lock_pair(a, b);
+    sharded_seq_begin(l);
+    skip_list_concat(a->list, b->list);
+    skip_list_destroy(b->list);
+    b->list = NULL;
+    b->index = -1;
+    int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+    for(int j=i+1; j<n-1; j++){
+        sharded_shard_t *s = sharded_at(l, j+1);
+        s->index = j;
+        atomic_store_explicit(&l->shards[j], s, memory_order_relaxed);
+        atomic_store_explicit(&l->bounds[j], atomic_load_explicit(&l->bounds[j+1], memory_order_relaxed), memory_order_relaxed);
+    }
+    atomic_store_explicit(&l->nshards, n-1, memory_order_relaxed);
+    sharded_seq_end(l);
+    atomic_store(&a->length, a->list->length);
+    atomic_store(&b->length, 0);
+    a->counted = a->list->length;
+    b->counted = 0;
+    sharded_set_limits(l, a);
+    pthread_mutex_unlock(&b->lock);
+    pthread_mutex_unlock(&a->lock);
+}
+
+
+//list的后一半, SKIPLIST_NO_RANK时沿着第0层找到中间的key
+static skip_list_t *sharded_split_half(skip_list_t *list){
+#ifdef SKIPLIST_NO_RANK
+    skip_node_t *x = list->header->level[0].forward;
+    for(unsigned long k=0; k<list->length/2; k++){
+        x = x->level[0].forward;
+    }
+    return skip_list_split_at_key(list, x->key);
+#else
+    return skip_list_split_at_rank(list, list->length/2);
+#endif
+}
+
+
+//把位置i的shard从中间split成两个. pool中没有空闲的shard时先合并最小的一对相邻shard, 它们加起来不到这个shard的一半才合并
+//shard的顺序有变化(split或者合并了)时返回true
+static bool sharded_split(sharded_skip_list_t *l, int i){
+    sharded_shard_t *s = sharded_at(l, i);
+    sharded_shard_t *t = NULL;
+    bool merged = false;
+    for(int k=0; k<l->max_shards && t==NULL; k++){
+        if(l->pool[k].list == NULL){
+            t = &l->pool[k];
+        }
+    }
+    if(t == NULL){
+        int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+        int best = -1;
+        unsigned long best_length = s->counted / 2;
+        for(int j=0; j+1<n; j++){
+            unsigned long length = sharded_at(l, j)->counted + sharded_at(l, j+1)->counted;
+            if(j != i && j+1 != i && length < best_length){
+                best = j;
+                best_length = length;
+            }
+        }
+        if(best < 0){
+            return false;
+        }
+        t = sharded_at(l, best+1);
+        sharded_merge(l, best);
+        merged = true;
+        i = s->index;
+    }
+    sharded_lock_pair(s, t);
+    //counted是加锁之前flush的, 这期间s可能被删除得很短, 太短时split出来的t可能是空的, 不能作为边界
+    if(s->list->length <= l->threshold){
+        pthread_mutex_unlock(&t->lock);
+        pthread_mutex_unlock(&s->lock);
+        return merged;
+    }
+    sharded_seq_begin(l);
+    t->list = sharded_split_half(s->list);
+    int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+    for(int j=n; j>i+1; j--){
+        sharded_shard_t *x = sharded_at(l, j-1);
+        x->index = j;
+        atomic_store_explicit(&l->shards[j], x, memory_order_relaxed);
+        atomic_store_explicit(&l->bounds[j], atomic_load_explicit(&l->bounds[j-1], memory_order_relaxed), memory_order_relaxed);
+    }
+    t->index = i+1;
+    atomic_store_explicit(&l->shards[i+1], t, memory_order_relaxed);
+    atomic_store_explicit(&l->bounds[i+1], t->list->header->level[0].forward->key.u64, memory_order_relaxed);
+    atomic_store_explicit(&l->nshards, n+1, memory_order_relaxed);
+    sharded_seq_end(l);
+    atomic_store(&s->length, s->list->length);
+    atomic_store(&t->length, t->list->length);
+    s->counted = s->list->length;
+    t->counted = t->list->length;
+    sharded_set_limits(l, s);
+    sharded_set_limits(l, t);
+    pthread_mutex_unlock(&t->lock);
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+
+
+/*
+shard的长度超出limit或者低于low之后调用. 已经有线程在调整时直接返回, 之后的写入会再次触发.
+目标长度上限是max(SHARDED_SPLIT_MIN, 2*总长度/max_shards): shard数没有用完时大于上限就split,
+用完之后要合并一对很小的相邻shard才能split; 低于上限的1/8时和较小的相邻shard合并.
+*/
+static void sharded_rebalance(sharded_skip_list_t *l, sharded_shard_t *s){
+    if(pthread_mutex_trylock(&l->lock) != 0){
+        return;
+    }
+    sharded_flush(l);
+    int n = atomic_load_explicit(&l->nshards, memory_order_relaxed);
+    unsigned long total = sharded_fenwick_prefix(l, n);
+    l->threshold = 2*total/l->max_shards > SHARDED_SPLIT_MIN ? 2*total/l->max_shards : SHARDED_SPLIT_MIN;
+    int i = s->index;
+    bool changed = false;
+    if(i >= 0 && s->counted > l->threshold){
+        changed = sharded_split(l, i);
+    }else if(i >= 0 && n > 1 && s->counted < l->threshold/8){
+        int j = i == 0 || (i+1 < n && sharded_at(l, i+1)->counted < sharded_at(l, i-1)->counted) ? i : i-1;
+        if(sharded_at(l, j)->counted + sharded_at(l, j+1)->counted < l->threshold/2){
+            sharded_merge(l, j);
+            changed = true;
+        }
+    }
+    if(changed){
+        sharded_fenwick_build(l);
+    }else if(s->list != NULL){
+        pthread_mutex_lock(&s->lock);
+        if(s->list != NULL){
+            sharded_set_limits(l, s);
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    pthread_mutex_unlock(&l->lock);
+}
+
+
+sharded_skip_list_t *sharded_skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare, int max_shards){
+    sharded_skip_list_t *l = malloc(sizeof(*l));
+    pthread_mutex_init(&l->lock, NULL);
+    atomic_init(&l->seq, 0);
+    atomic_init(&l->nshards, 1);
+    l->max_shards = max_shards > 1 ? max_shards : 1;
+    l->shards = malloc(l->max_shards * sizeof(*l->shards));
+    l->bounds = malloc(l->max_shards * sizeof(*l->bounds));
+    l->pool = aligned_alloc(64, l->max_shards * sizeof(sharded_shard_t));
+    l->fenwick = calloc(l->max_shards + 1, sizeof(*l->fenwick));
+    l->dirty = calloc((l->max_shards+SHARDED_DIRTY_BITS-1) / SHARDED_DIRTY_BITS, sizeof(*l->dirty));
+    l->threshold = SHARDED_SPLIT_MIN;
+    l->key_type = key_typeid;
+    l->value_type = value_typeid;
+    l->compare = compare;
+    //shards[]中nshards之后的位置也指向有效的shard, 查找时读到旧的nshards也不会访问空指针
+    for(int i=0; i<l->max_shards; i++){
+        sharded_shard_t *s = &l->pool[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->list = NULL;
+        s->limit = SHARDED_SPLIT_MIN;
+        s->low = 0;
+        atomic_init(&s->length, 0);
+        s->counted = 0;
+        s->index = -1;
+        s->id = i;
+        atomic_init(&l->shards[i], s);
+        atomic_init(&l->bounds[i], 0);
+    }
+    l->pool[0].list = skip_list_create(key_typeid, value_typeid, compare, 0);
+    l->pool[0].index = 0;
+    return l;
+}
+
+
+void sharded_skip_list_destroy(sharded_skip_list_t *l){
+    for(int i=0; i<l->max_shards; i++){
+        if(l->pool[i].list != NULL){
+            skip_list_destroy(l->pool[i].list);
+        }
+        pthread_mutex_destroy(&l->pool[i].lock);
+    }
+    pthread_mutex_destroy(&l->lock);
+    free(l->shards);
+    free((void *)l->bounds);
+    free(l->pool);
+    free(l->fenwick);
+    free(l->dirty);
+    free(l);
+}
+
+
+bool sharded_skip_list_insert(sharded_skip_list_t *l, element_t key, element_t value){
+    sharded_shard_t *s = sharded_lock_key(l, key);
+    bool inserted = skip_list_insert(s->list, key, value) != NULL;
+    bool rebalance = false;
+    if(inserted){
+        sharded_mark(l, s);
+        rebalance = s->list->length > s->limit;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if(rebalance){
+        sharded_rebalance(l, s);
+    }
+    return inserted;
+}
+
+
+bool sharded_skip_list_find(sharded_skip_list_t *l, element_t key, element_t *value){
+    sharded_shard_t *s = sharded_lock_key(l, key);
+    skip_node_t *node = skip_list_find(s->list, key);
+    if(node != NULL && value != NULL){
+        *value = node->value;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return node != NULL;
+}
+
+
+bool sharded_skip_list_remove(sharded_skip_list_t *l, element_t key){
+    sharded_shard_t *s = sharded_lock_key(l, key);
+    bool removed = skip_list_remove(s->list, key);
+    bool rebalance = false;
+    if(removed){
+        sharded_mark(l, s);
+        rebalance = s->list->length < s->low;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if(rebalance){
+        sharded_rebalance(l, s);
+    }
+    return removed;
+}
+
+
+unsigned long sharded_skip_list_length(sharded_skip_list_t *l){
+    pthread_mutex_lock(&l->lock);
+    sharded_flush(l);
+    unsigned long length = sharded_fenwick_prefix(l, atomic_load_explicit(&l->nshards, memory_order_relaxed));
+    pthread_mutex_unlock(&l->lock);
+    return length;
+}
+
+
+//持有l->lock时边界不会变化, shard的位置就是index
+unsigned long sharded_skip_list_get_rank(sharded_skip_list_t *l, element_t key){
+    pthread_mutex_lock(&l->lock);
+    sharded_flush(l);
+    sharded_shard_t *s = sharded_lock_key(l, key);
+    unsigned long rank = skip_list_get_rank(s->list, key);
+    pthread_mutex_unlock(&s->lock);
+    if(rank != 0){
+        rank += sharded_fenwick_prefix(l, s->index);
+    }
+    pthread_mutex_unlock(&l->lock);
+    return rank;
+}
+
+
+bool sharded_skip_list_get_by_rank(sharded_skip_list_t *l, unsigned long rank, element_t *key, element_t *value){
+    pthread_mutex_lock(&l->lock);
+    sharded_flush(l);
+    unsigned long before;
+    int pos = sharded_fenwick_find(l, rank, &before);
+    skip_node_t *node = NULL;
+    if(rank > 0 && pos < atomic_load_explicit(&l->nshards, memory_order_relaxed)){
+        sharded_shard_t *s = sharded_at(l, pos);
+        pthread_mutex_lock(&s->lock);
+        node = skip_list_get_node_by_rank(s->list, rank - before);
+        if(node != NULL && key != NULL){
+            *key = node->key;
+        }
+        if(node != NULL && value != NULL){
+            *value = node->value;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    pthread_mutex_unlock(&l->lock);
+    return node != NULL;
+}
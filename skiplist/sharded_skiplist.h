@@ -0,0 +1,171 @@
+#ifndef SHARDED_SKIPLIST_H
+#define SHARDED_SKIPLIST_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "skiplist.h"
+
+/*
+按key范围分片的并发skiplist: 每个shard是一个普通的skip_list_t, 有自己的互斥锁, 不同shard上的写入互不等待.
+shard的边界自动调整: 一个shard变得太大(热点范围)时从中间split成两个, 太小时和相邻的shard concat成一个,
+split/concat都是O(log n)的, 只在调整期间锁住相关的shard.
+查找shard不加锁: 边界数组由seq保护(seqlock), 锁住shard之后seq没有变化就说明找到的shard是对的, 否则重试.
+全局排名 = 前面各个shard的长度之和 + shard内的排名, shard长度的前缀和用shard上的Fenwick树计算.
+写入时只修改自己shard的长度和一个脏标记, Fenwick树由排名查询在全局锁下按脏标记更新,
+所以排名查询之间是串行的, 并且其他shard上同时进行的写入可能没有计算在内(近似值).
+key不能重复, 只支持整数和double类型的key. 节点直接malloc, 不使用arena(arena不是线程安全的).
+*/
+
+typedef struct sharded_shard sharded_shard_t;
+typedef struct sharded_skip_list sharded_skip_list_t;
+
+
+struct sharded_shard {
+    pthread_mutex_t lock;
+    skip_list_t *list; //NULL表示这个shard空闲
+    unsigned long limit; //list的长度超过limit时尝试split
+    unsigned long low; //list的长度低于low时尝试和相邻的shard合并
+    atomic_ulong length; //list->length的副本, 不加锁也可以读
+    unsigned long counted; //Fenwick树中记录的长度
+    int index; //在shards[]中的位置, 空闲时为-1
+    int id; //在pool[]中的下标, 也是脏标记的位
+} __attribute__((aligned(64)));
+
+
+struct sharded_skip_list {
+    pthread_mutex_t lock; //调整边界和排名查询
+    atomic_ulong seq; //shards[]和bounds[]的版本, 修改期间为奇数
+    atomic_int nshards;
+    int max_shards;
+    _Atomic(sharded_shard_t *) *shards; //按key范围排序
+    _Atomic uint64_t *bounds; //bounds[i]是shards[i]中最小的key(element_t的64位), bounds[0]不使用
+    sharded_shard_t *pool; //所有的shard, 共max_shards个
+    unsigned long *fenwick; //按shards[]中的位置, 下标从1开始
+    atomic_ulong *dirty; //按id的位图, 长度有变化还没有计入Fenwick树的shard
+    unsigned long threshold; //shard的目标长度上限, 调整时按总长度重新计算
+
+    element_type_t key_type;
+    element_type_t value_type;
+
+    compare_func_t compare;
+};
+
+
+sharded_skip_list_t *sharded_skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare, int max_shards);
+
+
+#define SHARDED_SKIP_LIST_CREATE(KEY_TYPE, VALUE_TYPE, max_shards) ({ \
+    KEY_TYPE __key__; \
+    VALUE_TYPE __value__; \
+    (void) __key__; \
+    (void) __value__; \
+    element_type_t __key_type__ = ELEMENT_TYPEID(__key__); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(__value__); \
+    if(__key_type__ == TSTR || __key_type__ == TPTR || __key_type__ == TUNKNOW){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ > TDOUBLE){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    sharded_skip_list_create(__key_type__, __value_type__, compare_func_list[__key_type__], (max_shards)); \
+})
+
+
+#ifndef NDEBUG
+
+#define SHARDED_SKIP_LIST_INSERT(list, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    sharded_skip_list_insert((list), (element_t)(key), (element_t)(value)); \
+})
+
+
+#define SHARDED_SKIP_LIST_FIND(list, key, value_ptr) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    sharded_skip_list_find((list), (element_t)(key), (value_ptr)); \
+})
+
+
+#define SHARDED_SKIP_LIST_REMOVE(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    sharded_skip_list_remove((list), (element_t)(key)); \
+})
+
+
+#define SHARDED_SKIP_LIST_GET_RANK(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    sharded_skip_list_get_rank((list), (element_t)(key)); \
+})
+
+#else
+
+#define SHARDED_SKIP_LIST_INSERT(list, key, value) (sharded_skip_list_insert((list), (element_t)(key), (element_t)(value)))
+
+
+#define SHARDED_SKIP_LIST_FIND(list, key, value_ptr) (sharded_skip_list_find((list), (element_t)(key), (value_ptr)))
+
+
+#define SHARDED_SKIP_LIST_REMOVE(list, key) (sharded_skip_list_remove((list), (element_t)(key)))
+
+
+#define SHARDED_SKIP_LIST_GET_RANK(list, key) (sharded_skip_list_get_rank((list), (element_t)(key)))
+
+#endif //NDEBUG
+
+
+#define SHARDED_SKIP_LIST_DESTROY(list) do{ sharded_skip_list_destroy((list)); (list)=NULL; } while(0)
+
+
+//destroy时不能有其他线程还在访问这个list
+void sharded_skip_list_destroy(sharded_skip_list_t *l);
+
+
+//key已经存在时返回false
+bool sharded_skip_list_insert(sharded_skip_list_t *l, element_t key, element_t value);
+
+
+//找到时把value复制到*value(可以为NULL)并返回true. 节点可能随时被其他线程删除或者移到别的shard, 所以不返回节点指针.
+bool sharded_skip_list_find(sharded_skip_list_t *l, element_t key, element_t *value);
+
+
+bool sharded_skip_list_remove(sharded_skip_list_t *l, element_t key);
+
+
+//所有shard的长度之和
+unsigned long sharded_skip_list_length(sharded_skip_list_t *l);
+
+
+//全局排名, 从1开始, 没有找到时返回0. SKIPLIST_NO_RANK时总是返回0
+unsigned long sharded_skip_list_get_rank(sharded_skip_list_t *l, element_t key);
+
+
+//把全局排名为rank的节点的key和value复制到key/value中(可以为NULL), 超出范围时返回false. SKIPLIST_NO_RANK时总是返回false
+bool sharded_skip_list_get_by_rank(sharded_skip_list_t *l, unsigned long rank, element_t *key, element_t *value);
+
+
+#endif //ifndef SHARDED_SKIPLIST_H
@@ -6,14 +6,48 @@
 #include <stdio.h>
 #include <limits.h>
 #include <errno.h>
+#include <math.h>
 
 #include "skiplist.h"
 
 
-#define SKIPLIST_MAXLEVEL 32 /* Should be enough for 2^64 elements */
 #define SKIPLIST_P 0.25      /* Skiplist P = 1/4 */
 
 
+#ifdef SKIPLIST_STATS
+#define SKIP_STATS_ADD(l, field, n) ((l)->stats.field += (n))
+#define SKIP_STATS_HOP(l, i) ((l)->stats.hops[(i)]++)
+#else
+#define SKIP_STATS_ADD(l, field, n) ((void)0)
+#define SKIP_STATS_HOP(l, i) ((void)0)
+#endif
+#define SKIP_STATS_INC(l, field) SKIP_STATS_ADD(l, field, 1)
+
+
+//只在维护排名时才执行的语句, SKIPLIST_NO_RANK时整个去掉
+#ifdef SKIPLIST_NO_RANK
+#define SKIP_RANK(...)
+#else
+#define SKIP_RANK(...) __VA_ARGS__
+#endif
+
+
+//只在每一层都有backward指针时才执行的语句
+#ifdef SKIPLIST_BACKLINKS
+#define SKIP_BACKLINK(...) __VA_ARGS__
+#else
+#define SKIP_BACKLINK(...)
+#endif
+
+
+//只在维护聚合值时才执行的语句
+#ifdef SKIPLIST_AGGREGATE
+#define SKIP_AGG(...) __VA_ARGS__
+#else
+#define SKIP_AGG(...)
+#endif
+
+
 char* const element_typename_list[] = {
     "i32", "u32", "i64", "u64", "string", "pointer", "double", "unknow type"
 };
@@ -52,6 +86,7 @@ skip_node_t *skip_node_create(int level, element_t key, element_t value){
     skip_node_t *node = malloc(sizeof(*node) + level*(sizeof(struct skiplist_level)));
     node->key = key;
     node->value = value;
+    SKIP_BACKLINK(node->height = level;)
     return node;
 }
 
@@ -61,6 +96,456 @@ void skip_node_destroy(skip_node_t *node){
 }
 
 
+/*
+arena: 按节点层数分size class的slab分配器.
+每个chunk按SKIP_ARENA_CHUNK_SIZE对齐, chunk头部记录自己的size class,
+这样释放节点时根据地址就能找到所属的class, 节点里面不需要保存层数.
+删除的节点挂到对应class的free list上复用, destroy时直接释放所有chunk, 不需要遍历list.
+split出来的list和原来的list共用同一个arena, 由refs计数, 最后一个list destroy时才释放chunk.
+*/
+#define SKIP_ARENA_CHUNK_SIZE (64*1024)
+
+typedef struct skip_arena_chunk skip_arena_chunk_t;
+
+struct skip_arena_chunk {
+    skip_arena_chunk_t *next;
+    int level; //本chunk中节点的层数
+    unsigned int used; //已经切分出去的字节数(包括chunk头)
+};
+
+struct skip_arena {
+    unsigned long refs; //共用这个arena的list个数
+    size_t prefix; //每个节点前面预留的字节数, SKIP_LIST_KEY_PREFIX时存放key的前缀
+    skip_arena_chunk_t *chunks; //所有chunk组成的链表
+    skip_arena_chunk_t *current[SKIPLIST_MAXLEVEL+1]; //每个size class当前正在切分的chunk
+    skip_node_t *free_list[SKIPLIST_MAXLEVEL+1]; //回收的节点, 通过backward串起来
+};
+
+#define SKIP_ARENA_CHUNK_HEADER_SIZE ((sizeof(skip_arena_chunk_t) + 15) & ~(size_t)15)
+#define SKIP_NODE_SIZE(level) (sizeof(skip_node_t) + (level)*sizeof(struct skiplist_level))
+
+
+static skip_arena_t *skip_arena_create(size_t prefix){
+    skip_arena_t *arena = calloc(1, sizeof(skip_arena_t));
+    arena->refs = 1;
+    arena->prefix = prefix;
+    return arena;
+}
+
+
+static void skip_arena_destroy(skip_arena_t *arena){
+    skip_arena_chunk_t *chunk = arena->chunks;
+    while(chunk != NULL){
+        skip_arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+
+static skip_node_t *skip_arena_alloc(skip_arena_t *arena, int level){
+    skip_node_t *node = arena->free_list[level];
+    if(node != NULL){
+        arena->free_list[level] = node->backward;
+        return node;
+    }
+    size_t size = arena->prefix + SKIP_NODE_SIZE(level);
+    if(arena->prefix != 0){
+        size = (size + 15) & ~(size_t)15; //前缀按16字节对齐, 不会跨cache line
+    }
+    skip_arena_chunk_t *chunk = arena->current[level];
+    if(chunk == NULL || chunk->used + size > SKIP_ARENA_CHUNK_SIZE){
+        chunk = aligned_alloc(SKIP_ARENA_CHUNK_SIZE, SKIP_ARENA_CHUNK_SIZE);
+        chunk->level = level;
+        chunk->used = SKIP_ARENA_CHUNK_HEADER_SIZE;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->current[level] = chunk;
+    }
+    node = (skip_node_t *)((char *)chunk + chunk->used + arena->prefix);
+    chunk->used += size;
+    return node;
+}
+
+
+static void skip_arena_free(skip_arena_t *arena, skip_node_t *node){
+    skip_arena_chunk_t *chunk = (skip_arena_chunk_t *)((uintptr_t)node & ~(uintptr_t)(SKIP_ARENA_CHUNK_SIZE-1));
+    node->backward = arena->free_list[chunk->level];
+    arena->free_list[chunk->level] = node;
+}
+
+
+//把src的所有chunk挂到dst上, 然后释放src. src的free list和正在切分的chunk不再使用, 它们的内存在dst释放时一起释放
+static void skip_arena_absorb(skip_arena_t *dst, skip_arena_t *src){
+    skip_arena_chunk_t **last = &src->chunks;
+    while(*last != NULL){
+        last = &(*last)->next;
+    }
+    *last = dst->chunks;
+    dst->chunks = src->chunks;
+    free(src);
+}
+
+
+/*
+SKIP_LIST_KEY_COPY: 字符串key复制到list私有的字符串arena中, 按chunk追加分配.
+删除节点时不回收字符串的空间, destroy时整块释放.
+*/
+#define SKIP_STR_CHUNK_SIZE (64*1024)
+
+typedef struct skip_str_chunk skip_str_chunk_t;
+
+struct skip_str_chunk {
+    skip_str_chunk_t *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct skip_str_arena {
+    unsigned long refs; //共用这个arena的list个数
+    skip_str_chunk_t *chunks; //第一个chunk是当前正在追加的chunk
+};
+
+
+static void skip_str_arena_destroy(skip_str_arena_t *arena){
+    skip_str_chunk_t *chunk = arena->chunks;
+    while(chunk != NULL){
+        skip_str_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+
+static char *skip_str_arena_dup(skip_str_arena_t *arena, const char *s){
+    size_t len = strlen(s) + 1;
+    skip_str_chunk_t *chunk = arena->chunks;
+    if(chunk == NULL || chunk->used + len > chunk->size){
+        //很长的字符串单独分配一个chunk, 挂在当前chunk后面, 不影响当前chunk继续追加
+        bool large = len > SKIP_STR_CHUNK_SIZE / 4;
+        size_t size = large ? len : SKIP_STR_CHUNK_SIZE - sizeof(skip_str_chunk_t);
+        skip_str_chunk_t *c = malloc(sizeof(skip_str_chunk_t) + size);
+        c->used = 0;
+        c->size = size;
+        if(large && chunk != NULL){
+            c->next = chunk->next;
+            chunk->next = c;
+        }else{
+            c->next = chunk;
+            arena->chunks = c;
+        }
+        chunk = c;
+    }
+    char *p = chunk->data + chunk->used;
+    memcpy(p, s, len);
+    chunk->used += len;
+    return p;
+}
+
+
+//把src的所有chunk挂到dst的当前chunk后面, 然后释放src
+static void skip_str_arena_absorb(skip_str_arena_t *dst, skip_str_arena_t *src){
+    if(src->chunks != NULL){
+        skip_str_chunk_t *last = src->chunks;
+        while(last->next != NULL){
+            last = last->next;
+        }
+        if(dst->chunks == NULL){
+            dst->chunks = src->chunks;
+        }else{
+            last->next = dst->chunks->next;
+            dst->chunks->next = src->chunks;
+        }
+    }
+    free(src);
+}
+
+
+/*
+SKIP_LIST_KEY_PREFIX: 字符串key的前16个字节按大端序组成两个整数, 存放在节点前面.
+整数的大小顺序和strcmp的顺序一致, 查找时前缀不同就能决定顺序, 不需要访问节点外面的字符串,
+前缀相同时才调用strcmp比较剩下的部分. URL/路径这类key的前几个字节经常相同, 所以用16个字节.
+*/
+typedef struct skip_prefix {
+    uint64_t hi;
+    uint64_t lo;
+} skip_prefix_t;
+
+#define SKIP_NODE_PREFIX_SIZE sizeof(skip_prefix_t)
+#define SKIP_NODE_PREFIX(node) (((skip_prefix_t *)(node))[-1])
+
+
+static inline uint64_t skip_str_prefix8(const char *s, bool *end){
+    uint64_t prefix = 0;
+    for(int i=0; i<8; i++){
+        unsigned char c = s[i];
+        if(c == 0){
+            *end = true;
+            break;
+        }
+        prefix |= (uint64_t)c << (56 - 8*i);
+    }
+    return prefix;
+}
+
+
+static inline skip_prefix_t skip_str_prefix(const char *s){
+    bool end = false;
+    skip_prefix_t prefix = {skip_str_prefix8(s, &end), 0};
+    if(!end){
+        prefix.lo = skip_str_prefix8(s+8, &end);
+    }
+    return prefix;
+}
+
+
+//没有SKIP_LIST_KEY_PREFIX时返回0, 不会被使用
+static inline skip_prefix_t skip_list_key_prefix(skip_list_t *l, element_t key){
+    return (l->flags & SKIP_LIST_KEY_PREFIX) ? skip_str_prefix(key.s) : (skip_prefix_t){0, 0};
+}
+
+
+//直接比较两个key, 和skip_node_compare一样计入stats.comparisons
+static inline int skip_key_compare(skip_list_t *l, element_t a, element_t b){
+    SKIP_STATS_INC(l, comparisons);
+    return l->compare(a, b);
+}
+
+
+//节点x的key和key比较, prefix是skip_list_key_prefix(l, key)
+static inline int skip_node_compare(skip_list_t *l, skip_node_t *x, element_t key, skip_prefix_t prefix){
+    SKIP_STATS_INC(l, comparisons);
+    if(l->flags & SKIP_LIST_KEY_PREFIX){
+        skip_prefix_t p = SKIP_NODE_PREFIX(x);
+        if(p.hi != prefix.hi){
+            return p.hi < prefix.hi ? -1 : 1;
+        }
+        if(p.lo != prefix.lo){
+            return p.lo < prefix.lo ? -1 : 1;
+        }
+        //前缀最后一个字节为0说明字符串在前缀内结束, 两个key相同
+        if((p.lo & 0xff) == 0){
+            return 0;
+        }
+        return strcmp(x->key.s + SKIP_NODE_PREFIX_SIZE, key.s + SKIP_NODE_PREFIX_SIZE);
+    }
+    return l->compare(x->key, key);
+}
+
+
+/*
+SKIP_LIST_PREFETCH: 查找时在第i层比较cur的后继, 同时预取cur在第i-1层的后继.
+在这一层停下来之后, 下一层要比较的就是它, 这样两次内存访问可以重叠, 不需要等前一个cache miss结束.
+*/
+static inline void skip_list_prefetch(skip_list_t *l, skip_node_t *cur, int i){
+    if((l->flags & SKIP_LIST_PREFETCH) && i > 0){
+        __builtin_prefetch(cur->level[i-1].forward);
+    }
+}
+
+
+static void skip_agg_empty(skip_list_t *l, skip_agg_t *agg){
+    agg->count = 0;
+    switch(l->value_type){
+    case TINT32:
+    case TINT64:
+        agg->sum.i64 = 0;
+        agg->min.i64 = INT64_MAX;
+        agg->max.i64 = INT64_MIN;
+        break;
+    case TUINT32:
+    case TUINT64:
+        agg->sum.u64 = 0;
+        agg->min.u64 = UINT64_MAX;
+        agg->max.u64 = 0;
+        break;
+    case TDOUBLE:
+        agg->sum.f = 0;
+        agg->min.f = INFINITY;
+        agg->max.f = -INFINITY;
+        break;
+    default:
+        agg->sum.u64 = agg->min.u64 = agg->max.u64 = 0;
+        break;
+    }
+}
+
+
+static void skip_agg_add_value(skip_list_t *l, skip_agg_t *agg, element_t value){
+    agg->count++;
+    switch(l->value_type){
+    case TINT32:
+        value.i64 = value.i32;
+        //fallthrough
+    case TINT64:
+        agg->sum.i64 += value.i64;
+        agg->min.i64 = value.i64 < agg->min.i64 ? value.i64 : agg->min.i64;
+        agg->max.i64 = value.i64 > agg->max.i64 ? value.i64 : agg->max.i64;
+        break;
+    case TUINT32:
+        value.u64 = value.u32;
+        //fallthrough
+    case TUINT64:
+        agg->sum.u64 += value.u64;
+        agg->min.u64 = value.u64 < agg->min.u64 ? value.u64 : agg->min.u64;
+        agg->max.u64 = value.u64 > agg->max.u64 ? value.u64 : agg->max.u64;
+        break;
+    case TDOUBLE:
+        agg->sum.f += value.f;
+        agg->min.f = value.f < agg->min.f ? value.f : agg->min.f;
+        agg->max.f = value.f > agg->max.f ? value.f : agg->max.f;
+        break;
+    default:
+        break;
+    }
+}
+
+
+#ifdef SKIPLIST_AGGREGATE
+static void skip_agg_merge(skip_list_t *l, skip_agg_t *agg, const skip_agg_t *other){
+    agg->count += other->count;
+    switch(l->value_type){
+    case TINT32:
+    case TINT64:
+        agg->sum.i64 += other->sum.i64;
+        agg->min.i64 = other->min.i64 < agg->min.i64 ? other->min.i64 : agg->min.i64;
+        agg->max.i64 = other->max.i64 > agg->max.i64 ? other->max.i64 : agg->max.i64;
+        break;
+    case TUINT32:
+    case TUINT64:
+        agg->sum.u64 += other->sum.u64;
+        agg->min.u64 = other->min.u64 < agg->min.u64 ? other->min.u64 : agg->min.u64;
+        agg->max.u64 = other->max.u64 > agg->max.u64 ? other->max.u64 : agg->max.u64;
+        break;
+    case TDOUBLE:
+        agg->sum.f += other->sum.f;
+        agg->min.f = other->min.f < agg->min.f ? other->min.f : agg->min.f;
+        agg->max.f = other->max.f > agg->max.f ? other->max.f : agg->max.f;
+        break;
+    default:
+        break;
+    }
+}
+
+
+//重新计算x在第i层的聚合值: 第0层是后继的value, 其他层合并下一层从x到x在第i层的后继之间的区间
+static void skip_agg_fix(skip_list_t *l, skip_node_t *x, int i){
+    skip_agg_t *agg = &x->level[i].agg;
+    skip_agg_empty(l, agg);
+    skip_node_t *stop = x->level[i].forward;
+    if(i == 0){
+        if(stop != l->header){
+            skip_agg_add_value(l, agg, stop->value);
+        }
+        return;
+    }
+    skip_node_t *y = x;
+    do{
+        skip_agg_merge(l, agg, &y->level[i-1].agg);
+        y = y->level[i-1].forward;
+    }while(y != stop);
+}
+
+
+//自底向上重新计算update[i]在每一层的聚合值, 用于区间删除和修改value
+static void skip_agg_fix_path(skip_list_t *l, skip_node_t **update){
+    for(int i=0; i<l->level; i++){
+        skip_agg_fix(l, update[i], i);
+    }
+}
+
+
+//插入node之后修正聚合值: node所在的层区间被分开, 重新计算; 更高的层只需要加上node的value
+static void skip_agg_link(skip_list_t *l, skip_node_t **update, skip_node_t *node, int level){
+    for(int i=0; i<level; i++){
+        skip_agg_fix(l, node, i);
+        skip_agg_fix(l, update[i], i);
+    }
+    for(int i=level; i<l->level; i++){
+        skip_agg_add_value(l, &update[i]->level[i].agg, node->value);
+    }
+}
+
+
+//摘下value所在的节点(层数为level)之后修正聚合值: 节点所在的层重新计算;
+//更高的层对整数value直接减去, 删除的value是最小值或者最大值时才需要重新计算. double的和做减法会有误差, 总是重新计算
+static void skip_agg_unlink(skip_list_t *l, skip_node_t **update, element_t value, int level){
+    int i = 0;
+    for(; i<level && i<l->level; i++){
+        skip_agg_fix(l, update[i], i);
+    }
+    for(; i<l->level; i++){
+        skip_agg_t *agg = &update[i]->level[i].agg;
+        switch(l->value_type){
+        case TINT32:
+            value.i64 = value.i32;
+            //fallthrough
+        case TINT64:
+            if(value.i64 != agg->min.i64 && value.i64 != agg->max.i64){
+                agg->count--;
+                agg->sum.i64 -= value.i64;
+                continue;
+            }
+            break;
+        case TUINT32:
+            value.u64 = value.u32;
+            //fallthrough
+        case TUINT64:
+            if(value.u64 != agg->min.u64 && value.u64 != agg->max.u64){
+                agg->count--;
+                agg->sum.u64 -= value.u64;
+                continue;
+            }
+            break;
+        case TDOUBLE:
+            break;
+        default:
+            agg->count--;
+            continue;
+        }
+        skip_agg_fix(l, update[i], i);
+    }
+}
+#endif
+
+
+static skip_node_t *skip_list_node_create(skip_list_t *l, int level, element_t key, element_t value){
+    if(l->str_arena != NULL){
+        key.s = skip_str_arena_dup(l->str_arena, key.s);
+    }
+    skip_node_t *node;
+    if(l->arena != NULL){
+        node = skip_arena_alloc(l->arena, level);
+    }else if(l->flags & SKIP_LIST_KEY_PREFIX){
+        char *mem = malloc(SKIP_NODE_PREFIX_SIZE + SKIP_NODE_SIZE(level));
+        node = (skip_node_t *)(mem + SKIP_NODE_PREFIX_SIZE);
+    }else{
+        return skip_node_create(level, key, value);
+    }
+    node->key = key;
+    node->value = value;
+    SKIP_BACKLINK(node->height = level;)
+    if(l->flags & SKIP_LIST_KEY_PREFIX){
+        SKIP_NODE_PREFIX(node) = skip_str_prefix(key.s);
+    }
+    return node;
+}
+
+
+static void skip_list_node_destroy(skip_list_t *l, skip_node_t *node){
+    if(l->arena != NULL){
+        skip_arena_free(l->arena, node);
+    }else if(l->flags & SKIP_LIST_KEY_PREFIX){
+        free((char *)node - SKIP_NODE_PREFIX_SIZE);
+    }else{
+        skip_node_destroy(node);
+    }
+}
+
+
 static const print_element_func_t print_element_func_list[TDOUBLE+1] = {
     &print_element_i32,
     &print_element_u32,
@@ -104,6 +589,9 @@ void skip_list_print(skip_list_t *l){
 
 
 void skip_list_rank_print(skip_list_t *l){
+#ifdef SKIPLIST_NO_RANK
+    skip_list_print(l);
+#else
     printf("list count: %lu, level is %d.\n", l->length, l->level);
     for(int i=l->level-1; i>=0; i--){
         printf("level %d(span%lu): ", i,l->header->level[i].span);
@@ -113,6 +601,7 @@ void skip_list_rank_print(skip_list_t *l){
         }
         printf("NULL\n");
     }
+#endif
 }
 
 void skip_list_addr_print(skip_list_t *l){
@@ -149,20 +638,50 @@ static int element_compare_s(element_t e1, element_t e2){
     return strcmp(e1.s, e2.s);
 }
 
+static int element_compare_f(element_t e1, element_t e2){
+    return e1.f<e2.f ? -1 : (e1.f==e2.f ? 0 : 1);
+}
+
 
-skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare){
-    skip_list_t *slist = malloc(sizeof(*slist));
-    slist->level = 1;
-    slist->length = 0;
-    skip_node_t *header = skip_node_create(SKIPLIST_MAXLEVEL, (element_t)0, (element_t)0);
+//把header恢复成空list的状态, 不释放节点
+static void skip_list_reset(skip_list_t *l){
+    l->level = 1;
+    l->length = 0;
+    skip_node_t *header = l->header;
     header->backward = header;
     for(int i=0; i<SKIPLIST_MAXLEVEL; i++){
         header->level[i].forward = header;
-        header->level[i].span = 0;
+        SKIP_BACKLINK(header->level[i].backward = header;)
+        SKIP_RANK(header->level[i].span = 0;)
+        SKIP_AGG(skip_agg_empty(l, &header->level[i].agg);)
+        l->tail[i] = header;
+    }
+}
+
+
+skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare, unsigned int flags){
+    skip_list_t *slist = malloc(sizeof(*slist));
+    //前缀和复制key只对使用strcmp顺序的字符串key有效
+    if(key_typeid != TSTR || compare != element_compare_s){
+        flags &= ~(SKIP_LIST_KEY_PREFIX | SKIP_LIST_KEY_COPY);
+    }
+    slist->flags = flags;
+    slist->arena = (flags & SKIP_LIST_ARENA) ? skip_arena_create((flags & SKIP_LIST_KEY_PREFIX) ? SKIP_NODE_PREFIX_SIZE : 0) : NULL;
+    slist->str_arena = NULL;
+    if(flags & SKIP_LIST_KEY_COPY){
+        slist->str_arena = calloc(1, sizeof(skip_str_arena_t));
+        slist->str_arena->refs = 1;
     }
-    slist->header = header;
+    slist->finger = NULL;
+    slist->append_fast = 0;
+    slist->append_fallback = 0;
+#ifdef SKIPLIST_STATS
+    memset(&slist->stats, 0, sizeof(slist->stats));
+#endif
+    slist->header = skip_node_create(SKIPLIST_MAXLEVEL, (element_t)0, (element_t)0);
     slist->key_type = key_typeid;
     slist->value_type = value_typeid;
+    skip_list_reset(slist);
     slist->compare = compare;
     slist->print_key = print_element_func_list[key_typeid];
     slist->print_value = print_element_func_list[value_typeid];
@@ -171,224 +690,713 @@ skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_ty
 
 
 void skip_list_destroy(skip_list_t *l){
-    skip_node_t *cur = l->header->level[0].forward;
-    for(skip_node_t *next=cur->level[0].forward; cur!=l->header; cur=next, next=cur->level[0].forward){
-        skip_node_destroy(cur);
+    if(l->arena != NULL && l->arena->refs == 1){
+        skip_arena_destroy(l->arena);
+    }else{
+        //arena还有别的list在用时把节点还给arena
+        skip_node_t *cur = l->header->level[0].forward;
+        for(skip_node_t *next=cur->level[0].forward; cur!=l->header; cur=next, next=cur->level[0].forward){
+            skip_list_node_destroy(l, cur);
+        }
+        if(l->arena != NULL){
+            l->arena->refs--;
+        }
+    }
+    if(l->str_arena != NULL && --l->str_arena->refs == 0){
+        skip_str_arena_destroy(l->str_arena);
     }
     skip_node_destroy(l->header);
+    free(l->finger);
     free(l);
 }
 
+//每个线程自己的随机数状态: glibc的rand()有一把全局锁, 多个线程同时插入不同的list(例如sharded_skiplist的各个shard)时会互相等待.
+//第一次使用时由rand()初始化, 单线程程序的层数仍然由srand决定
+static _Thread_local uint64_t level_seed = 0;
+
+
 static int random_level(void) {
-    static const int threshold = SKIPLIST_P*RAND_MAX;
+    static const uint32_t threshold = SKIPLIST_P*4294967296.0;
+    uint64_t x = level_seed;
+    if(x == 0){
+        x = ((uint64_t)rand() << 32 | (uint64_t)rand()) | 1;
+    }
     int level = 1;
-    while (rand() < threshold)
+    for(;;){
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        if((uint32_t)(x >> 32) >= threshold){
+            break;
+        }
         level += 1;
+    }
+    level_seed = x;
     return (level<SKIPLIST_MAXLEVEL) ? level : SKIPLIST_MAXLEVEL;
 }
 
 
-skip_node_t *skip_list_insert(skip_list_t *l, element_t key, element_t value){
-    skip_node_t *update[SKIPLIST_MAXLEVEL] = {};
-    unsigned long rank[SKIPLIST_MAXLEVEL] = {};
-    skip_node_t *cur = l->header;
-    for(int i=l->level-1; i>=0; i--){
-        rank[i] = i == (l->level-1) ? 0 : rank[i+1];
-        while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key , key);
-            if(comp < 0){
-                rank[i] += cur->level[i].span;
-                cur = cur->level[i].forward;
-            }else if(comp == 0){
-                return NULL;
-            }else {
-                break;
-            }
-        }
-        update[i] = cur;
-    }
-    int insert_level = random_level();
-    skip_node_t *node = skip_node_create(insert_level, key, value);
-    if(insert_level > l->level){
-        for(int i=l->level; i<insert_level; i++){
-            rank[i] = 0;
+//把node链接到update[]之后, update[i]是第i层的前驱, rank[i]是它的排名. 层数增加时会补齐新层的update和rank.
+static void skip_list_link(skip_list_t *l, skip_node_t *node, int level, skip_node_t **update, unsigned long *rank){
+    if(level > l->level){
+        for(int i=l->level; i<level; i++){
             update[i] = l->header;
-            update[i]->level[i].span = l->length;
+            SKIP_RANK(rank[i] = 0;)
+            SKIP_RANK(update[i]->level[i].span = l->length;)
         }
-        l->level = insert_level;
+        l->level = level;
     }
-    for(int i=0; i<insert_level ; i++){
+    for(int i=0; i<level ; i++){
         node->level[i].forward = update[i]->level[i].forward;
         skip_node_t *prev = update[i];
         prev->level[i].forward = node;
-        node->level[i].span = prev->level[i].span - (rank[0] - rank[i]);
-        prev->level[i].span = (rank[0] - rank[i])+1;
+        SKIP_BACKLINK(node->level[i].backward = prev;)
+        SKIP_BACKLINK(node->level[i].forward->level[i].backward = node;)
+        SKIP_RANK(node->level[i].span = prev->level[i].span - (rank[0] - rank[i]);)
+        SKIP_RANK(prev->level[i].span = (rank[0] - rank[i])+1;)
+        if(node->level[i].forward == l->header){
+            l->tail[i] = node;
+        }
     }
     node->backward = update[0];
     node->level[0].forward->backward = node;
-    for(int i=insert_level; i < l->level; i++){
+    SKIP_RANK(for(int i=level; i < l->level; i++){
         update[i]->level[i].span++;
-    }
+    })
+    SKIP_AGG(skip_agg_link(l, update, node, level);)
     l->length++;
-    return node;
+    SKIP_STATS_INC(l, inserts);
 }
 
 
-skip_node_t *skip_list_insert_multi(skip_list_t *l, element_t key, element_t value){
-    skip_node_t *update[SKIPLIST_MAXLEVEL] = {};
-    unsigned long rank[SKIPLIST_MAXLEVEL] = {};
-    int insert_level = random_level();
-    skip_node_t *node = skip_node_create(insert_level, key, value);
-    skip_node_t *cur = l->header;
-    for(int i=l->level-1; i>=0; i--){
-        rank[i] = i == (l->level-1) ? 0 : rank[i+1];
-        while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key , key);
-            if(comp < 0 || (comp == 0 && cur->level[i].forward < node)){
-                rank[i] += cur->level[i].span;
-                cur = cur->level[i].forward;
-            }else{
-                break;
-            }
-        }
-        update[i] = cur;
+/*
+finger: 记录某个位置P在每一层的前驱, update[i]是第i层最后一个不在P之后的节点, rank[i]是它的排名.
+从finger出发查找时先向上爬到需要的层, 再向下走, 代价是O(log d), d是和上一个位置之间的距离,
+而不是每次都从header开始O(log n)的查找. 查找结束后finger就是新key的前驱, 可以直接用来插入删除.
+*/
+struct skip_finger {
+    skip_node_t *update[SKIPLIST_MAXLEVEL];
+    unsigned long rank[SKIPLIST_MAXLEVEL];
+    bool valid; //缓存在list上的finger, 不经过finger的修改操作会让它失效
+};
+
+
+static inline void skip_list_finger_invalidate(skip_list_t *l){
+    if(l->finger != NULL){
+        l->finger->valid = false;
     }
-    if(insert_level > l->level){
-        for(int i=l->level; i<insert_level; i++){
-            rank[i] = 0;
-            update[i] = l->header;
-            update[i]->level[i].span = l->length;
+}
+
+
+static void skip_finger_reset(skip_list_t *l, skip_finger_t *f){
+    for(int i=0; i<SKIPLIST_MAXLEVEL; i++){
+        f->update[i] = l->header;
+        SKIP_RANK(f->rank[i] = 0;)
+    }
+}
+
+
+//节点x是否排在(key, node)之前, 相同key按节点地址排序. node为NULL时只比较key.
+static inline bool skip_node_before(skip_list_t *l, skip_node_t *x, element_t key, skip_prefix_t prefix, skip_node_t *node){
+    if(x == l->header){
+        return true;
+    }
+    int comp = skip_node_compare(l, x, key, prefix);
+    return comp < 0 || (comp == 0 && x < node);
+}
+
+
+//从top层开始向下查找, 结束后update[i]为第i层最后一个排在(key, node)之前的节点.
+//forward为true表示finger原来的位置P在目标之前, 这时低层原有的update[i]都可以作为起点:
+//上面各层都没有向前走时cur就是原来的update[i+1], 原来的update[i]不在它之前; 向前走过之后cur已经不在P之前, 从cur继续.
+static void skip_finger_descend(skip_list_t *l, skip_finger_t *f, int top, bool forward, element_t key, skip_node_t *node){
+    skip_prefix_t prefix = skip_list_key_prefix(l, key);
+    skip_node_t *cur = f->update[top];
+    SKIP_STATS_INC(l, descents);
+    SKIP_RANK(unsigned long rank = f->rank[top];)
+    bool moved = false;
+    for(int i=top; i>=0; i--){
+        if(forward && !moved){
+            cur = f->update[i];
+            SKIP_RANK(rank = f->rank[i];)
+        }
+        while(cur->level[i].forward != l->header && skip_node_before(l, cur->level[i].forward, key, prefix, node)){
+            SKIP_RANK(rank += cur->level[i].span;)
+            SKIP_STATS_HOP(l, i);
+            cur = cur->level[i].forward;
+            moved = true;
         }
-        l->level = insert_level;
+        f->update[i] = cur;
+        SKIP_RANK(f->rank[i] = rank;)
     }
-    for(int i=0; i<insert_level ; i++){
-        node->level[i].forward = update[i]->level[i].forward;
-        skip_node_t *prev = update[i];
-        prev->level[i].forward = node;
-        node->level[i].span = prev->level[i].span - (rank[0] - rank[i]);
-        prev->level[i].span = (rank[0] - rank[i])+1;
+}
+
+
+static void skip_finger_seek(skip_list_t *l, skip_finger_t *f, element_t key, skip_node_t *node){
+    skip_prefix_t prefix = skip_list_key_prefix(l, key);
+    bool forward = skip_node_before(l, f->update[0], key, prefix, node);
+    int i = 0;
+    //向上爬: 直到本层的前驱在目标之前, 并且上一层的后继不在目标之前
+    //向前查找时所有的update[i]都在P之前, 不需要再比较
+    while(i < l->level-1){
+        if(!forward && !skip_node_before(l, f->update[i], key, prefix, node)){
+            i++;
+            continue;
+        }
+        skip_node_t *next = f->update[i+1]->level[i+1].forward;
+        if(next != l->header && skip_node_before(l, next, key, prefix, node)){
+            i++;
+            continue;
+        }
+        break;
     }
-    node->backward = update[0];
-    node->level[0].forward->backward = node;
-    for(int i=insert_level; i < l->level; i++){
-        update[i]->level[i].span++;
+    if(!forward && !skip_node_before(l, f->update[i], key, prefix, node)){
+        f->update[i] = l->header;
+        SKIP_RANK(f->rank[i] = 0;)
     }
-    l->length++;
-    return node;
+    skip_finger_descend(l, f, i, forward, key, node);
 }
 
 
+//插入之后把finger移动到新节点上
+static void skip_finger_advance(skip_finger_t *f, skip_node_t *node, int level){
+    SKIP_RANK(unsigned long rank = f->rank[0] + 1;)
+    for(int i=0; i<level; i++){
+        f->update[i] = node;
+        SKIP_RANK(f->rank[i] = rank;)
+    }
+}
+
 
-skip_node_t *skip_list_find(skip_list_t *l, element_t ele){
+skip_node_t *skip_list_insert(skip_list_t *l, element_t key, element_t value){
+    skip_prefix_t prefix = skip_list_key_prefix(l, key);
+    skip_node_t *update[SKIPLIST_MAXLEVEL] = {};
+    unsigned long rank[SKIPLIST_MAXLEVEL];
     skip_node_t *cur = l->header;
-    for (int i = l->level-1; i >= 0; i--) {
+    SKIP_STATS_INC(l, descents);
+    for(int i=l->level-1; i>=0; i--){
+        SKIP_RANK(rank[i] = i == (l->level-1) ? 0 : rank[i+1];)
         while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key, ele);
+            skip_list_prefetch(l, cur, i);
+            int comp = skip_node_compare(l, cur->level[i].forward, key, prefix);
             if(comp < 0){
+                SKIP_RANK(rank[i] += cur->level[i].span;)
+                SKIP_STATS_HOP(l, i);
                 cur = cur->level[i].forward;
+            }else if(comp == 0){
+                SKIP_STATS_INC(l, duplicates);
+                return NULL;
             }else {
                 break;
             }
         }
+        update[i] = cur;
     }
-    skip_node_t *next = cur->level[0].forward;
-    if(next != l->header && l->compare(next->key, ele) == 0){
-        return next;
-    }else{
-       return NULL;
-    }
+    int insert_level = random_level();
+    skip_node_t *node = skip_list_node_create(l, insert_level, key, value);
+    skip_list_finger_invalidate(l);
+    skip_list_link(l, node, insert_level, update, rank);
+    return node;
 }
 
 
-bool skip_list_remove(skip_list_t *l, element_t ele){
+//按照insert_multi的顺序插入一个已经分配好的节点
+static void skip_list_insert_node_multi(skip_list_t *l, skip_node_t *node, int insert_level){
+    skip_prefix_t prefix = skip_list_key_prefix(l, node->key);
     skip_node_t *update[SKIPLIST_MAXLEVEL] = {};
+    unsigned long rank[SKIPLIST_MAXLEVEL];
     skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
     for(int i=l->level-1; i>=0; i--){
+        SKIP_RANK(rank[i] = i == (l->level-1) ? 0 : rank[i+1];)
         while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key, ele);
-            if(comp < 0){
+            skip_list_prefetch(l, cur, i);
+            int comp = skip_node_compare(l, cur->level[i].forward, node->key, prefix);
+            if(comp < 0 || (comp == 0 && cur->level[i].forward < node)){
+                SKIP_RANK(rank[i] += cur->level[i].span;)
+                SKIP_STATS_HOP(l, i);
                 cur = cur->level[i].forward;
-            }else {
+            }else{
                 break;
             }
         }
         update[i] = cur;
     }
-    cur = cur->level[0].forward;
-    if(cur == l->header || l->compare(cur->key, ele) != 0){
-        return false;
-    }
+    skip_list_finger_invalidate(l);
+    skip_list_link(l, node, insert_level, update, rank);
+}
+
+
+skip_node_t *skip_list_insert_multi(skip_list_t *l, element_t key, element_t value){
+    int insert_level = random_level();
+    skip_node_t *node = skip_list_node_create(l, insert_level, key, value);
+    skip_list_insert_node_multi(l, node, insert_level);
+    return node;
+}
+
+
+//在末尾追加node, 利用每一层的最后一个节点l->tail[i]直接设置span, 不需要查找
+static void skip_list_append_node(skip_list_t *l, skip_node_t *node, int level){
+    SKIP_AGG(skip_node_t *update[SKIPLIST_MAXLEVEL];)
+    if(level > l->level){
+        SKIP_RANK(for(int i=l->level; i<level; i++){
+            l->header->level[i].span = l->length;
+        })
+        l->level = level;
+    }
+    SKIP_AGG(memcpy(update, l->tail, l->level * sizeof(*update));)
+    for(int i=0; i<level; i++){
+        skip_node_t *prev = l->tail[i];
+        prev->level[i].forward = node;
+        SKIP_RANK(prev->level[i].span++;)
+        node->level[i].forward = l->header;
+        SKIP_RANK(node->level[i].span = 0;)
+        SKIP_BACKLINK(node->level[i].backward = prev;)
+        SKIP_BACKLINK(l->header->level[i].backward = node;)
+        l->tail[i] = node;
+    }
+    SKIP_RANK(for(int i=level; i<l->level; i++){
+        l->tail[i]->level[i].span++;
+    })
+    node->backward = l->header->backward;
+    l->header->backward = node;
+    SKIP_AGG(skip_agg_link(l, update, node, level);)
+    l->length++;
+    SKIP_STATS_INC(l, inserts);
+}
+
+
+skip_node_t *skip_list_append(skip_list_t *l, element_t key, element_t value){
+    skip_node_t *last = l->header->backward;
+    if(last != l->header){
+        int comp = skip_key_compare(l, last->key, key);
+        if(comp > 0){
+            l->append_fallback++;
+            return skip_list_insert(l, key, value);
+        }else if(comp == 0){
+            l->append_fast++;
+            SKIP_STATS_INC(l, duplicates);
+            return NULL;
+        }
+    }
+    l->append_fast++;
+    int insert_level = random_level();
+    skip_node_t *node = skip_list_node_create(l, insert_level, key, value);
+    skip_list_finger_invalidate(l);
+    skip_list_append_node(l, node, insert_level);
+    return node;
+}
+
+
+skip_node_t *skip_list_append_multi(skip_list_t *l, element_t key, element_t value){
+    int insert_level = random_level();
+    skip_node_t *node = skip_list_node_create(l, insert_level, key, value);
+    skip_node_t *last = l->header->backward;
+    if(last != l->header){
+        int comp = skip_key_compare(l, last->key, key);
+        if(comp > 0 || (comp == 0 && last > node)){
+            l->append_fallback++;
+            skip_list_insert_node_multi(l, node, insert_level);
+            return node;
+        }
+    }
+    l->append_fast++;
+    skip_list_finger_invalidate(l);
+    skip_list_append_node(l, node, insert_level);
+    return node;
+}
+
+
+
+skip_node_t *skip_list_find(skip_list_t *l, element_t ele){
+    skip_prefix_t prefix = skip_list_key_prefix(l, ele);
+    skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
+    for (int i = l->level-1; i >= 0; i--) {
+        while(cur->level[i].forward != l->header){
+            skip_list_prefetch(l, cur, i);
+            int comp = skip_node_compare(l, cur->level[i].forward, ele, prefix);
+            if(comp < 0){
+                SKIP_STATS_HOP(l, i);
+                cur = cur->level[i].forward;
+            }else {
+                break;
+            }
+        }
+    }
+    skip_node_t *next = cur->level[0].forward;
+    if(next != l->header && skip_node_compare(l, next, ele, prefix) == 0){
+        return next;
+    }else{
+       return NULL;
+    }
+}
+
+
+//把node从list中摘下来但不释放, update[i]是node在第i层的前驱. 返回node的层数
+static int skip_list_unlink(skip_list_t *l, skip_node_t *node, skip_node_t **update){
+    int level = 0;
     for(int i=l->level-1; i>=0 ; i--){
         skip_node_t *prev = update[i];
-        if(prev->level[i].forward == cur){
-            prev->level[i].span  += cur->level[i].span - 1;
-            prev->level[i].forward = cur->level[i].forward;
+        if(prev->level[i].forward == node){
+            level++;
+            SKIP_RANK(prev->level[i].span  += node->level[i].span - 1;)
+            prev->level[i].forward = node->level[i].forward;
+            SKIP_BACKLINK(prev->level[i].forward->level[i].backward = prev;)
+            if(l->tail[i] == node){
+                l->tail[i] = prev;
+            }
         }else{
-            prev->level[i].span --;
+            SKIP_RANK(prev->level[i].span--;)
         }
     }
-    skip_node_t *next = cur->level[0].forward;
+    skip_node_t *next = node->level[0].forward;
     next->backward = update[0];
-    skip_node_destroy(cur);
     l->length--;
+    SKIP_STATS_INC(l, removes);
     while(l->level>1 && l->header->level[l->level-1].forward == l->header){
         l->level--;
     }
-    return true;
+    SKIP_AGG(skip_agg_unlink(l, update, node->value, level);)
+    return level;
 }
 
 
-bool skip_list_remove_node(skip_list_t *l, skip_node_t *node){
-    if(node == NULL || node == l->header){
+bool skip_list_remove(skip_list_t *l, element_t ele){
+    skip_prefix_t prefix = skip_list_key_prefix(l, ele);
+    skip_node_t *update[SKIPLIST_MAXLEVEL] = {};
+    skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
+    for(int i=l->level-1; i>=0; i--){
+        while(cur->level[i].forward != l->header){
+            int comp = skip_node_compare(l, cur->level[i].forward, ele, prefix);
+            if(comp < 0){
+                SKIP_STATS_HOP(l, i);
+                cur = cur->level[i].forward;
+            }else {
+                break;
+            }
+        }
+        update[i] = cur;
+    }
+    cur = cur->level[0].forward;
+    if(cur == l->header || skip_node_compare(l, cur, ele, prefix) != 0){
         return false;
     }
+    skip_list_finger_invalidate(l);
+    skip_list_unlink(l, cur, update);
+    skip_list_node_destroy(l, cur);
+    return true;
+}
+
+
+#ifdef SKIPLIST_BACKLINKS
+//沿着backward得到node在每一层的前驱, 不需要比较key.
+//高于node的层的前驱是下一层往前第一个层数更高的节点, 这些层只需要把span减1和修正聚合值, 两者都不需要时不用找.
+static void skip_list_backlink_path(skip_list_t *l, skip_node_t *node, skip_node_t **update){
+    int i = 0;
+    for(; i<node->height; i++){
+        update[i] = node->level[i].backward;
+    }
+#if defined(SKIPLIST_NO_RANK) && !defined(SKIPLIST_AGGREGATE)
+    for(; i<l->level; i++){
+        update[i] = l->header;
+    }
+#else
+    skip_node_t *prev = update[i-1];
+    for(; i<l->level; i++){
+        while(prev->height <= i){
+            prev = prev->level[i-1].backward;
+        }
+        update[i] = prev;
+    }
+#endif
+}
+#endif
+
+
+//得到node在每一层的前驱update[i]和它的排名rank[i], node不在list中时返回false.
+//SKIPLIST_BACKLINKS时沿着backward得到前驱, 不计算排名.
+static bool skip_list_node_path(skip_list_t *l, skip_node_t *node, skip_node_t **update, unsigned long *rank){
+#ifdef SKIPLIST_BACKLINKS
+    (void)rank;
+    skip_list_backlink_path(l, node, update);
+    return true;
+#else
     element_t ele = node->key;
-    skip_node_t *update[SKIPLIST_MAXLEVEL] = {};
+    skip_prefix_t prefix = skip_list_key_prefix(l, ele);
     skip_node_t *cur = l->header;
+    SKIP_RANK(unsigned long traversed = 0;)
+    SKIP_STATS_INC(l, descents);
     for(int i=l->level-1; i>=0; i--){
         while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key , ele);
+            int comp = skip_node_compare(l, cur->level[i].forward, ele, prefix);
             if(comp < 0 || (comp == 0 && cur->level[i].forward < node)){
+                SKIP_RANK(traversed += cur->level[i].span;)
+                SKIP_STATS_HOP(l, i);
                 cur = cur->level[i].forward;
             }else{
                 break;
             }
         }
         update[i] = cur;
+        SKIP_RANK(rank[i] = traversed;)
     }
-    cur = cur->level[0].forward;
-    if(cur == l->header || cur != node){
+    return cur->level[0].forward == node;
+#endif
+}
+
+
+bool skip_list_remove_node(skip_list_t *l, skip_node_t *node){
+    if(node == NULL || node == l->header){
         return false;
     }
-    skip_node_t *prev;
-    for(int i=l->level-1; i>=0 ; i--){
-        prev = update[i];
-        if(prev->level[i].forward == node){
-            prev->level[i].span  += cur->level[i].span - 1;
-            prev->level[i].forward = cur->level[i].forward;
+    skip_node_t *update[SKIPLIST_MAXLEVEL];
+    unsigned long rank[SKIPLIST_MAXLEVEL];
+    if(!skip_list_node_path(l, node, update, rank)){
+        return false;
+    }
+    skip_list_finger_invalidate(l);
+    skip_list_unlink(l, node, update);
+    skip_list_node_destroy(l, node);
+    return true;
+}
+
+
+//弹出node, update[i]是它在每一层的前驱, key和value可以为NULL
+static void skip_list_pop_node(skip_list_t *l, skip_node_t *node, skip_node_t **update, element_t *key, element_t *value){
+    if(key != NULL){
+        *key = node->key;
+    }
+    if(value != NULL){
+        *value = node->value;
+    }
+    skip_list_finger_invalidate(l);
+    skip_list_unlink(l, node, update);
+    skip_list_node_destroy(l, node);
+}
+
+
+bool skip_list_pop_min(skip_list_t *l, element_t *key, element_t *value){
+    skip_node_t *node = l->header->level[0].forward;
+    if(node == l->header){
+        return false;
+    }
+    //第一个节点在每一层的前驱都是header
+    skip_node_t *update[SKIPLIST_MAXLEVEL];
+    for(int i=0; i<l->level; i++){
+        update[i] = l->header;
+    }
+    skip_list_pop_node(l, node, update, key, value);
+    return true;
+}
+
+
+bool skip_list_pop_max(skip_list_t *l, element_t *key, element_t *value){
+    skip_node_t *node = l->header->backward;
+    if(node == l->header){
+        return false;
+    }
+    //最后一个节点不在的层, 前驱就是这一层的最后一个节点; 在的层从上一层的前驱沿着这一层走到它之前, 不需要比较key
+    skip_node_t *update[SKIPLIST_MAXLEVEL];
+    skip_node_t *cur = l->header;
+    for(int i=l->level-1; i>=0; i--){
+        if(l->tail[i] != node){
+            cur = l->tail[i];
         }else{
-            prev->level[i].span--;
+#ifdef SKIPLIST_BACKLINKS
+            cur = node->level[i].backward;
+#else
+            while(cur->level[i].forward != node){
+                cur = cur->level[i].forward;
+            }
+#endif
         }
+        update[i] = cur;
+    }
+    skip_list_pop_node(l, node, update, key, value);
+    return true;
+}
+
+
+skip_node_t *skip_list_update_key(skip_list_t *l, skip_node_t *node, element_t key){
+    if(node == NULL || node == l->header){
+        return NULL;
+    }
+    if(l->str_arena != NULL){
+        key.s = skip_str_arena_dup(l->str_arena, key.s);
     }
+    skip_prefix_t prefix = skip_list_key_prefix(l, key);
+    //新的key仍然在前后两个节点之间时直接修改, 位置不变, finger也仍然有效
     skip_node_t *next = node->level[0].forward;
-    next->backward = update[0];
-    skip_node_destroy(node);
-    l->length--;
-    while(l->level>1 && l->header->level[l->level-1].forward == l->header){
-        l->level--;
+    if(skip_node_before(l, node->backward, key, prefix, node) && (next == l->header || !skip_node_before(l, next, key, prefix, node))){
+        node->key = key;
+        if(l->flags & SKIP_LIST_KEY_PREFIX){
+            SKIP_NODE_PREFIX(node) = prefix;
+        }
+        return node;
+    }
+    //摘下来之后f就是原来位置的finger, 从这里出发查找新的位置, 代价和移动的距离有关
+    skip_finger_t f;
+    if(!skip_list_node_path(l, node, f.update, f.rank)){
+        return NULL;
+    }
+    skip_list_finger_invalidate(l);
+    int level = skip_list_unlink(l, node, f.update);
+    node->key = key;
+    if(l->flags & SKIP_LIST_KEY_PREFIX){
+        SKIP_NODE_PREFIX(node) = prefix;
+    }
+#if defined(SKIPLIST_BACKLINKS) && !defined(SKIPLIST_NO_RANK)
+    //backward得到的前驱没有排名, 只能从header开始查找
+    skip_list_insert_node_multi(l, node, level);
+#else
+    skip_finger_seek(l, &f, key, node);
+    skip_list_link(l, node, level, f.update, f.rank);
+#endif
+    return node;
+}
+
+
+bool skip_list_update_value(skip_list_t *l, skip_node_t *node, element_t value){
+    if(node == NULL || node == l->header){
+        return false;
+    }
+#ifdef SKIPLIST_AGGREGATE
+    //每一层包含node的区间都在node的前驱上
+    skip_node_t *update[SKIPLIST_MAXLEVEL];
+    unsigned long rank[SKIPLIST_MAXLEVEL];
+    if(!skip_list_node_path(l, node, update, rank)){
+        return false;
+    }
+    node->value = value;
+    skip_agg_fix_path(l, update);
+#else
+    node->value = value;
+#endif
+    return true;
+}
+
+
+//hint版本的操作共用list上缓存的finger. hint是finger的位置或者它的下一个节点时, 从finger出发查找,
+//否则从header开始查找. 查找结束后finger留在目标的前驱上, 插入时移动到新节点上,
+//所以把返回的节点作为下一次的hint总是有效的.
+static skip_finger_t *skip_list_hint_seek(skip_list_t *l, skip_node_t *hint, element_t key, skip_node_t *node){
+    if(l->finger == NULL){
+        l->finger = malloc(sizeof(*l->finger));
+        l->finger->valid = false;
+    }
+    skip_finger_t *f = l->finger;
+    if(f->valid && hint != NULL && (hint == f->update[0] || hint == f->update[0]->level[0].forward)){
+        skip_finger_seek(l, f, key, node);
+    }else{
+        skip_finger_reset(l, f);
+        skip_finger_descend(l, f, l->level-1, false, key, node);
+        f->valid = true;
+    }
+    return f;
+}
+
+
+skip_node_t *skip_list_insert_hint(skip_list_t *l, skip_node_t *hint, element_t key, element_t value){
+    skip_finger_t *f = skip_list_hint_seek(l, hint, key, NULL);
+    skip_node_t *next = f->update[0]->level[0].forward;
+    if(next != l->header && skip_key_compare(l, next->key, key) == 0){
+        SKIP_STATS_INC(l, duplicates);
+        return NULL;
+    }
+    int insert_level = random_level();
+    skip_node_t *node = skip_list_node_create(l, insert_level, key, value);
+    skip_list_link(l, node, insert_level, f->update, f->rank);
+    skip_finger_advance(f, node, insert_level);
+    return node;
+}
+
+
+skip_node_t *skip_list_insert_multi_hint(skip_list_t *l, skip_node_t *hint, element_t key, element_t value){
+    int insert_level = random_level();
+    skip_node_t *node = skip_list_node_create(l, insert_level, key, value);
+    skip_finger_t *f = skip_list_hint_seek(l, hint, key, node);
+    skip_list_link(l, node, insert_level, f->update, f->rank);
+    skip_finger_advance(f, node, insert_level);
+    return node;
+}
+
+
+skip_node_t *skip_list_find_hint(skip_list_t *l, skip_node_t *hint, element_t ele){
+    skip_finger_t *f = skip_list_hint_seek(l, hint, ele, NULL);
+    skip_node_t *next = f->update[0]->level[0].forward;
+    if(next != l->header && skip_key_compare(l, next->key, ele) == 0){
+        return next;
+    }else{
+        return NULL;
+    }
+}
+
+
+bool skip_list_remove_hint(skip_list_t *l, skip_node_t *hint, element_t ele){
+    skip_finger_t *f = skip_list_hint_seek(l, hint, ele, NULL);
+    skip_node_t *cur = f->update[0]->level[0].forward;
+    if(cur == l->header || skip_key_compare(l, cur->key, ele) != 0){
+        return false;
     }
+    skip_list_unlink(l, cur, f->update);
+    skip_list_node_destroy(l, cur);
     return true;
 }
 
 
+#ifdef SKIPLIST_NO_RANK
+
+//没有span, 排名相关的操作都失败
+unsigned long skip_list_get_rank(skip_list_t *l, element_t ele){
+    (void)l;
+    (void)ele;
+    return 0;
+}
+
+
+unsigned long skip_list_get_node_rank(skip_list_t *l, skip_node_t *node){
+    (void)l;
+    (void)node;
+    return 0;
+}
+
+
+skip_node_t *skip_list_get_node_by_rank(skip_list_t *l, unsigned long rank){
+    (void)l;
+    (void)rank;
+    return NULL;
+}
+
+
+void skip_list_get_nodes_by_rank(skip_list_t *l, const unsigned long *ranks, unsigned long n, skip_node_t **out){
+    (void)l;
+    (void)ranks;
+    memset(out, 0, n * sizeof(*out));
+}
+
+
+void skip_list_quantiles(skip_list_t *l, const double *qs, unsigned long n, skip_node_t **out){
+    (void)l;
+    (void)qs;
+    memset(out, 0, n * sizeof(*out));
+}
+
+#else
+
 unsigned long skip_list_get_rank(skip_list_t *l, element_t ele){
+    skip_prefix_t prefix = skip_list_key_prefix(l, ele);
     unsigned long rank = 0;
     skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
     for (int i = l->level-1; i >= 0; i--) {
         while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key , ele);
+            skip_list_prefetch(l, cur, i);
+            int comp = skip_node_compare(l, cur->level[i].forward, ele, prefix);
             if(comp < 0){
                 rank += cur->level[i].span;
+                SKIP_STATS_HOP(l, i);
                 cur = cur->level[i].forward;
             }else{
                 break;
@@ -397,7 +1405,7 @@ unsigned long skip_list_get_rank(skip_list_t *l, element_t ele){
     }
     rank += cur->level[0].span;
     cur = cur->level[0].forward;
-    if(cur != l->header && l->compare(cur->key, ele) == 0){
+    if(cur != l->header && skip_node_compare(l, cur, ele, prefix) == 0){
         return rank;
     }else{
         return 0;
@@ -409,13 +1417,26 @@ unsigned long skip_list_get_node_rank(skip_list_t *l, skip_node_t *node){
     if(node == NULL || node == l->header){
         return ENOENT;
     }
+#ifdef SKIPLIST_BACKLINKS
+    //沿着每个节点最高一层的backward走回header, 经过的span之和就是排名
+    unsigned long rank = 0;
+    for(skip_node_t *x=node; x!=l->header; ){
+        skip_node_t *prev = x->level[x->height-1].backward;
+        rank += prev->level[x->height-1].span;
+        x = prev;
+    }
+    return rank;
+#else
+    skip_prefix_t prefix = skip_list_key_prefix(l, node->key);
     unsigned long rank = 0;
     skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
     for(int i = l->level-1; i >= 0; i--) {
         while(cur->level[i].forward != l->header){
-            int comp = l->compare(cur->level[i].forward->key , node->key);
+            int comp = skip_node_compare(l, cur->level[i].forward, node->key, prefix);
             if(comp < 0 || (comp == 0 && cur->level[i].forward <= node)){
                 rank += cur->level[i].span;
+                SKIP_STATS_HOP(l, i);
                 cur = cur->level[i].forward;
             }else{
                 break;
@@ -427,16 +1448,24 @@ unsigned long skip_list_get_node_rank(skip_list_t *l, skip_node_t *node){
     }else{
         return 0;
     }
+#endif
 }
 
 
 skip_node_t *skip_list_get_node_by_rank(skip_list_t *l, unsigned long rank){
+    if(rank == 0 || rank > l->length){
+        return NULL;
+    }
     unsigned long traversed = 0;
     skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
 
     for (int i = l->level-1; i >= 0; i--) {
-        while (cur->level[i].forward && (traversed + cur->level[i].span) <= rank){
+        //每一层最后一个节点的span是到末尾的距离, 不能走到header上
+        while (cur->level[i].forward != l->header && (traversed + cur->level[i].span) <= rank){
+            skip_list_prefetch(l, cur, i);
             traversed += cur->level[i].span;
+            SKIP_STATS_HOP(l, i);
             cur = cur->level[i].forward;
         }
         if (traversed == rank){
@@ -447,10 +1476,1141 @@ skip_node_t *skip_list_get_node_by_rank(skip_list_t *l, unsigned long rank){
 }
 
 
-const compare_func_t compare_func_list[TSTR+1] = {
-    element_compare_i32,
-    element_compare_u32,
-    element_compare_i64,
-    element_compare_u64,
-    element_compare_s
-};
+//查询个数不多时(例如几个百分位)不需要分配内存
+#define RANK_QUERY_STACK 32
+
+
+typedef struct rank_query {
+    unsigned long rank;
+    unsigned long index; //结果在out中的下标
+    skip_node_t *cur; //当前层停下的节点
+    unsigned long traversed; //cur的排名
+} rank_query_t;
+
+
+static int rank_query_compare(const void *a, const void *b){
+    unsigned long r1 = ((const rank_query_t *)a)->rank;
+    unsigned long r2 = ((const rank_query_t *)b)->rank;
+    return r1 < r2 ? -1 : (r1 == r2 ? 0 : 1);
+}
+
+
+//查询通常只有几个并且已经有序, 用插入排序
+static void rank_query_sort(rank_query_t *queries, unsigned long n){
+    for(unsigned long i=1; i<n; i++){
+        rank_query_t q = queries[i];
+        unsigned long j = i;
+        while(j > 0 && queries[j-1].rank > q.rank){
+            queries[j] = queries[j-1];
+            j--;
+        }
+        queries[j] = q;
+    }
+}
+
+
+//所有查询一起一层一层向下走: 同一层中各个查询互不依赖, cpu可以同时等待它们的cache miss;
+//排好序的查询在上面几层停在同样的节点上, 后面的查询走过的节点已经在cache中.
+//走完一层时预取下一层的后继.
+static void skip_list_rank_queries(skip_list_t *l, rank_query_t *queries, unsigned long n, skip_node_t **out){
+    if(n <= RANK_QUERY_STACK){
+        rank_query_sort(queries, n);
+    }else{
+        qsort(queries, n, sizeof(*queries), rank_query_compare);
+    }
+    //去掉超出范围的排名
+    unsigned long m = 0;
+    for(unsigned long j=0; j<n; j++){
+        out[queries[j].index] = NULL;
+        if(queries[j].rank == 0 || queries[j].rank > l->length){
+            continue;
+        }
+        SKIP_STATS_INC(l, descents);
+        queries[m] = queries[j];
+        queries[m].cur = l->header;
+        queries[m].traversed = 0;
+        m++;
+    }
+    for(int i=l->level-1; i>=0; i--){
+        for(unsigned long j=0; j<m; j++){
+            rank_query_t *q = &queries[j];
+            skip_node_t *cur = q->cur;
+            unsigned long traversed = q->traversed;
+            while(cur->level[i].forward != l->header && traversed + cur->level[i].span <= q->rank){
+                traversed += cur->level[i].span;
+                SKIP_STATS_HOP(l, i);
+                cur = cur->level[i].forward;
+            }
+            if(i > 0 && traversed != q->rank){
+                __builtin_prefetch(cur->level[i-1].forward);
+            }
+            q->cur = cur;
+            q->traversed = traversed;
+        }
+    }
+    for(unsigned long j=0; j<m; j++){
+        out[queries[j].index] = queries[j].cur;
+    }
+}
+
+
+void skip_list_get_nodes_by_rank(skip_list_t *l, const unsigned long *ranks, unsigned long n, skip_node_t **out){
+    rank_query_t stack[RANK_QUERY_STACK];
+    rank_query_t *queries = n <= RANK_QUERY_STACK ? stack : malloc(n * sizeof(*queries));
+    for(unsigned long i=0; i<n; i++){
+        queries[i].rank = ranks[i];
+        queries[i].index = i;
+    }
+    skip_list_rank_queries(l, queries, n, out);
+    if(queries != stack){
+        free(queries);
+    }
+}
+
+
+void skip_list_quantiles(skip_list_t *l, const double *qs, unsigned long n, skip_node_t **out){
+    rank_query_t stack[RANK_QUERY_STACK];
+    rank_query_t *queries = n <= RANK_QUERY_STACK ? stack : malloc(n * sizeof(*queries));
+    for(unsigned long i=0; i<n; i++){
+        //nearest-rank: 排名为ceil(q*length)的节点
+        double x = qs[i] * l->length;
+        unsigned long rank = 1;
+        if(qs[i] >= 1){
+            rank = l->length;
+        }else if(qs[i] > 0){
+            rank = (unsigned long)x;
+            rank += rank < x;
+        }
+        queries[i].rank = rank;
+        queries[i].index = i;
+    }
+    skip_list_rank_queries(l, queries, n, out);
+    if(queries != stack){
+        free(queries);
+    }
+}
+
+#endif //SKIPLIST_NO_RANK
+
+
+unsigned long skip_list_select(skip_list_t *l, unsigned long k, bool largest, skip_node_t **out){
+    unsigned long n = 0;
+    skip_node_t *cur;
+    if(largest){
+        skip_list_foreach_reverse(cur, l){
+            if(n == k){
+                break;
+            }
+            out[n++] = cur;
+        }
+    }else{
+        skip_list_foreach(cur, l){
+            if(n == k){
+                break;
+            }
+            out[n++] = cur;
+        }
+    }
+    return n;
+}
+
+
+skip_node_t *skip_list_lower_bound(skip_list_t *l, element_t ele){
+    skip_prefix_t prefix = skip_list_key_prefix(l, ele);
+    skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
+    for (int i = l->level-1; i >= 0; i--) {
+        while(cur->level[i].forward != l->header && skip_node_compare(l, cur->level[i].forward, ele, prefix) < 0){
+            SKIP_STATS_HOP(l, i);
+            cur = cur->level[i].forward;
+        }
+    }
+    cur = cur->level[0].forward;
+    return cur != l->header ? cur : NULL;
+}
+
+
+skip_node_t *skip_list_upper_bound(skip_list_t *l, element_t ele){
+    skip_prefix_t prefix = skip_list_key_prefix(l, ele);
+    skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
+    for (int i = l->level-1; i >= 0; i--) {
+        while(cur->level[i].forward != l->header && skip_node_compare(l, cur->level[i].forward, ele, prefix) <= 0){
+            SKIP_STATS_HOP(l, i);
+            cur = cur->level[i].forward;
+        }
+    }
+    cur = cur->level[0].forward;
+    return cur != l->header ? cur : NULL;
+}
+
+
+#ifndef SKIPLIST_NO_RANK
+//update[i]为第i层最后一个排名不超过rank的节点
+static void skip_list_rank_path(skip_list_t *l, unsigned long target, skip_node_t **update, unsigned long *rank){
+    skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
+    unsigned long traversed = 0;
+    for(int i=l->level-1; i>=0; i--){
+        while(cur->level[i].forward != l->header && traversed + cur->level[i].span <= target){
+            traversed += cur->level[i].span;
+            SKIP_STATS_HOP(l, i);
+            cur = cur->level[i].forward;
+        }
+        update[i] = cur;
+        rank[i] = traversed;
+    }
+}
+#endif
+
+
+//删除排名在(a->rank[0], b->rank[0]]之间的节点, a和b是区间两端在每一层的前驱.
+//每一层的span只修正一次, 然后沿着第0层释放节点.
+static unsigned long skip_list_remove_between(skip_list_t *l, skip_finger_t *a, skip_finger_t *b){
+    skip_node_t *cur = a->update[0]->level[0].forward;
+    skip_node_t *end = b->update[0]->level[0].forward;
+#ifdef SKIPLIST_NO_RANK
+    unsigned long removed = 0;
+    for(skip_node_t *x=cur; x!=end; x=x->level[0].forward){
+        removed++;
+    }
+#else
+    unsigned long removed = b->rank[0] - a->rank[0];
+#endif
+    if(cur == end){
+        return 0;
+    }
+    skip_list_finger_invalidate(l);
+    for(int i=0; i<l->level; i++){
+        skip_node_t *prev = a->update[i];
+        skip_node_t *last = b->update[i];
+        SKIP_RANK(prev->level[i].span = b->rank[i] + last->level[i].span - a->rank[i] - removed;)
+        if(last != prev){
+            prev->level[i].forward = last->level[i].forward;
+            SKIP_BACKLINK(prev->level[i].forward->level[i].backward = prev;)
+            if(prev->level[i].forward == l->header){
+                l->tail[i] = prev;
+            }
+        }
+    }
+    end->backward = a->update[0];
+    while(cur != end){
+        skip_node_t *next = cur->level[0].forward;
+        skip_list_node_destroy(l, cur);
+        cur = next;
+    }
+    l->length -= removed;
+    SKIP_STATS_ADD(l, removes, removed);
+    while(l->level>1 && l->header->level[l->level-1].forward == l->header){
+        l->level--;
+    }
+    SKIP_AGG(skip_agg_fix_path(l, a->update);)
+    return removed;
+}
+
+
+unsigned long skip_list_count_range(skip_list_t *l, element_t lo, element_t hi){
+    if(skip_key_compare(l, lo, hi) >= 0){
+        return 0;
+    }
+    skip_finger_t f;
+    skip_finger_reset(l, &f);
+    skip_finger_descend(l, &f, l->level-1, false, lo, NULL);
+#ifdef SKIPLIST_NO_RANK
+    //没有span, 只能沿着第0层逐个计数
+    skip_prefix_t prefix = skip_list_key_prefix(l, hi);
+    unsigned long count = 0;
+    for(skip_node_t *cur=f.update[0]->level[0].forward; cur!=l->header && skip_node_compare(l, cur, hi, prefix) < 0; cur=cur->level[0].forward){
+        count++;
+    }
+    return count;
+#else
+    unsigned long lo_rank = f.rank[0];
+    skip_finger_seek(l, &f, hi, NULL);
+    return f.rank[0] - lo_rank;
+#endif
+}
+
+
+unsigned long skip_list_aggregate_range(skip_list_t *l, element_t lo, element_t hi, skip_agg_t *agg){
+    skip_agg_empty(l, agg);
+    if(skip_key_compare(l, lo, hi) >= 0){
+        return 0;
+    }
+    skip_prefix_t prefix = skip_list_key_prefix(l, hi);
+#ifdef SKIPLIST_AGGREGATE
+    skip_finger_t f;
+    skip_finger_reset(l, &f);
+    skip_finger_descend(l, &f, l->level-1, false, lo, NULL);
+    //cur是第i层第一个不小于lo的节点, 先向上: 上一层的这个节点仍然在hi之前时, 合并这一层到它之间的区间
+    skip_node_t *cur = f.update[0]->level[0].forward;
+    if(cur == l->header || !skip_node_before(l, cur, hi, prefix, NULL)){
+        return 0;
+    }
+    skip_agg_add_value(l, agg, cur->value);
+    int i = 0;
+    for(; i<l->level-1; i++){
+        skip_node_t *next = f.update[i+1]->level[i+1].forward;
+        if(next == l->header || !skip_node_before(l, next, hi, prefix, NULL)){
+            break;
+        }
+        for(; cur!=next; cur=cur->level[i].forward){
+            skip_agg_merge(l, agg, &cur->level[i].agg);
+        }
+    }
+    //再向下: 合并后继仍然在hi之前的区间
+    for(; i>=0; i--){
+        while(cur->level[i].forward != l->header && skip_node_before(l, cur->level[i].forward, hi, prefix, NULL)){
+            skip_agg_merge(l, agg, &cur->level[i].agg);
+            SKIP_STATS_HOP(l, i);
+            cur = cur->level[i].forward;
+        }
+    }
+#else
+    for(skip_node_t *cur=skip_list_lower_bound(l, lo); cur!=NULL && cur!=l->header && skip_node_compare(l, cur, hi, prefix) < 0; cur=cur->level[0].forward){
+        skip_agg_add_value(l, agg, cur->value);
+    }
+#endif
+    return agg->count;
+}
+
+
+unsigned long skip_list_aggregate_prefix(skip_list_t *l, unsigned long rank, skip_agg_t *agg){
+    skip_agg_empty(l, agg);
+#ifdef SKIPLIST_AGGREGATE
+    //和按排名查找一样向下走, 每一层的count就是span
+    skip_node_t *cur = l->header;
+    SKIP_STATS_INC(l, descents);
+    for(int i=l->level-1; i>=0; i--){
+        while(cur->level[i].forward != l->header && agg->count + cur->level[i].agg.count <= rank){
+            skip_agg_merge(l, agg, &cur->level[i].agg);
+            SKIP_STATS_HOP(l, i);
+            cur = cur->level[i].forward;
+        }
+    }
+#else
+    skip_node_t *cur;
+    skip_list_foreach(cur, l){
+        if(agg->count == rank){
+            break;
+        }
+        skip_agg_add_value(l, agg, cur->value);
+    }
+#endif
+    return agg->count;
+}
+
+
+unsigned long skip_list_remove_range(skip_list_t *l, element_t lo, element_t hi){
+    if(skip_key_compare(l, lo, hi) >= 0){
+        return 0;
+    }
+    skip_finger_t a, b;
+    skip_finger_reset(l, &a);
+    skip_finger_descend(l, &a, l->level-1, false, lo, NULL);
+    b = a;
+    skip_finger_seek(l, &b, hi, NULL);
+    return skip_list_remove_between(l, &a, &b);
+}
+
+
+unsigned long skip_list_remove_rank_range(skip_list_t *l, unsigned long start, unsigned long end){
+    if(end > l->length){
+        end = l->length;
+    }
+    if(start == 0 || start > end){
+        return 0;
+    }
+#ifdef SKIPLIST_NO_RANK
+    return 0;
+#else
+    skip_finger_t a, b;
+    skip_list_rank_path(l, start-1, a.update, a.rank);
+    skip_list_rank_path(l, end, b.update, b.rank);
+    return skip_list_remove_between(l, &a, &b);
+#endif
+}
+
+
+unsigned long skip_list_pop_min_n(skip_list_t *l, unsigned long k, element_t *keys, element_t *values){
+    //先沿着第0层取出前k个节点的key和value, end是第k+1个节点
+    unsigned long n = 0;
+    skip_node_t *end = l->header->level[0].forward;
+    for(; n<k && end!=l->header; n++, end=end->level[0].forward){
+        if(keys != NULL){
+            keys[n] = end->key;
+        }
+        if(values != NULL){
+            values[n] = end->value;
+        }
+    }
+    if(n == 0){
+        return 0;
+    }
+    //a是header, b是end在每一层的前驱, 整个前缀一次摘下, 每一层的span只修正一次
+    skip_finger_t a, b;
+    skip_finger_reset(l, &a);
+    if(end == l->header){
+        for(int i=0; i<l->level; i++){
+            b.update[i] = l->tail[i];
+            SKIP_RANK(b.rank[i] = l->length - l->tail[i]->level[i].span;)
+        }
+    }else{
+        skip_finger_reset(l, &b);
+        skip_finger_descend(l, &b, l->level-1, false, end->key, end);
+    }
+    return skip_list_remove_between(l, &a, &b);
+}
+
+
+/*
+split/concat: 只在切开或者接上的位置修改每一层的forward, span和backward, 节点不需要移动, O(log n).
+节点属于list的arena和字符串arena, split出来的list和原来的list共用arena(refs加1);
+concat时把b的arena并入a的arena, 两边的arena都还有别的list在用时无法合并.
+*/
+//和l同样类型, 比较函数和flag的空list, 共用l的arena
+static skip_list_t *skip_list_create_sibling(skip_list_t *l){
+    skip_list_t *r = skip_list_create(l->key_type, l->value_type, l->compare, l->flags & ~(SKIP_LIST_ARENA | SKIP_LIST_KEY_COPY));
+    r->flags = l->flags;
+    r->arena = l->arena;
+    if(r->arena != NULL){
+        r->arena->refs++;
+    }
+    r->str_arena = l->str_arena;
+    if(r->str_arena != NULL){
+        r->str_arena->refs++;
+    }
+    r->print_key = l->print_key;
+    r->print_value = l->print_value;
+    return r;
+}
+
+
+//从f的位置切开: f.update[i]是第i层最后一个留在l中的节点, f.rank[i]是它的排名. 后面的节点移到新的list中
+static skip_list_t *skip_list_split_at(skip_list_t *l, skip_finger_t *f){
+    skip_list_t *r = skip_list_create_sibling(l);
+    skip_list_finger_invalidate(l);
+#ifdef SKIPLIST_NO_RANK
+    //没有span, 只能沿着第0层数出移走的节点个数
+    unsigned long moved = 0;
+    for(skip_node_t *x=f->update[0]->level[0].forward; x!=l->header; x=x->level[0].forward){
+        moved++;
+    }
+#else
+    unsigned long moved = l->length - f->rank[0];
+#endif
+    if(moved == 0){
+        return r;
+    }
+    for(int i=0; i<l->level; i++){
+        skip_node_t *x = f->update[i];
+        skip_node_t *first = x->level[i].forward;
+        SKIP_RANK(r->header->level[i].span = f->rank[i] + x->level[i].span - f->rank[0];)
+        SKIP_RANK(x->level[i].span = f->rank[0] - f->rank[i];)
+        if(first == l->header){
+            continue;
+        }
+        r->header->level[i].forward = first;
+        SKIP_BACKLINK(first->level[i].backward = r->header;)
+        r->tail[i] = l->tail[i];
+        r->tail[i]->level[i].forward = r->header;
+        SKIP_BACKLINK(r->header->level[i].backward = r->tail[i];)
+        x->level[i].forward = l->header;
+        SKIP_BACKLINK(l->header->level[i].backward = x;)
+        l->tail[i] = x;
+        r->level = i+1;
+    }
+    r->header->backward = l->header->backward;
+    r->header->level[0].forward->backward = r->header;
+    l->header->backward = f->update[0];
+    r->length = moved;
+    l->length -= moved;
+    while(l->level>1 && l->header->level[l->level-1].forward == l->header){
+        l->level--;
+    }
+    SKIP_AGG(skip_agg_fix_path(l, f->update);
+    for(int i=0; i<r->level; i++){
+        skip_agg_fix(r, r->header, i);
+    })
+    return r;
+}
+
+
+skip_list_t *skip_list_split_at_key(skip_list_t *l, element_t key){
+    skip_finger_t f;
+    skip_finger_reset(l, &f);
+    skip_finger_descend(l, &f, l->level-1, false, key, NULL);
+    return skip_list_split_at(l, &f);
+}
+
+
+skip_list_t *skip_list_split_at_rank(skip_list_t *l, unsigned long rank){
+#ifdef SKIPLIST_NO_RANK
+    (void)rank;
+    return NULL;
+#else
+    skip_finger_t f;
+    skip_list_rank_path(l, rank < l->length ? rank : l->length, f.update, f.rank);
+    return skip_list_split_at(l, &f);
+#endif
+}
+
+
+bool skip_list_concat(skip_list_t *a, skip_list_t *b){
+    unsigned int layout = SKIP_LIST_ARENA | SKIP_LIST_KEY_PREFIX | SKIP_LIST_KEY_COPY;
+    if(a == b || a->key_type != b->key_type || a->value_type != b->value_type || a->compare != b->compare
+            || (a->flags & layout) != (b->flags & layout)){
+        return false;
+    }
+    if(a->length > 0 && b->length > 0){
+        //相同的key按节点地址排序, 所以a的最后一个节点也要排在b的第一个节点之前
+        skip_node_t *last = a->header->backward;
+        skip_node_t *first = b->header->level[0].forward;
+        int comp = skip_key_compare(a, last->key, first->key);
+        if(comp > 0 || (comp == 0 && last > first)){
+            return false;
+        }
+    }
+    //arena不同时把只属于一个list的arena并入另一个, 之后a和b共用同一个arena
+    bool arena_shared = a->arena != b->arena && a->arena->refs > 1 && b->arena->refs > 1;
+    bool str_arena_shared = a->str_arena != b->str_arena && a->str_arena->refs > 1 && b->str_arena->refs > 1;
+    if(arena_shared || str_arena_shared){
+        return false;
+    }
+    if(a->arena != b->arena){
+        skip_arena_t *dst = b->arena->refs == 1 ? a->arena : b->arena;
+        skip_arena_absorb(dst, dst == a->arena ? b->arena : a->arena);
+        a->arena = b->arena = dst;
+        dst->refs++;
+    }
+    if(a->str_arena != b->str_arena){
+        skip_str_arena_t *dst = b->str_arena->refs == 1 ? a->str_arena : b->str_arena;
+        skip_str_arena_absorb(dst, dst == a->str_arena ? b->str_arena : a->str_arena);
+        a->str_arena = b->str_arena = dst;
+        dst->refs++;
+    }
+    skip_list_finger_invalidate(a);
+    skip_list_finger_invalidate(b);
+    if(b->length == 0){
+        return true;
+    }
+    int level = a->level > b->level ? a->level : b->level;
+    SKIP_AGG(skip_node_t *tails[SKIPLIST_MAXLEVEL];)
+    for(int i=0; i<level; i++){
+        //a在第i层的最后一个节点和它的排名, 高于a->level的层是header
+        skip_node_t *x = i < a->level ? a->tail[i] : a->header;
+        SKIP_AGG(tails[i] = x;)
+        skip_node_t *first = b->header->level[i].forward;
+        SKIP_RANK(unsigned long rank = i < a->level ? a->length - x->level[i].span : 0;)
+        SKIP_RANK(x->level[i].span = a->length - rank + (first == b->header ? b->length : b->header->level[i].span);)
+        if(first == b->header){
+            continue;
+        }
+        x->level[i].forward = first;
+        SKIP_BACKLINK(first->level[i].backward = x;)
+        a->tail[i] = b->tail[i];
+        a->tail[i]->level[i].forward = a->header;
+        SKIP_BACKLINK(a->header->level[i].backward = a->tail[i];)
+    }
+    b->header->level[0].forward->backward = a->header->backward;
+    a->header->backward = b->header->backward;
+    a->length += b->length;
+    a->level = level;
+    skip_list_reset(b);
+    SKIP_AGG(for(int i=0; i<level; i++){
+        skip_agg_fix(a, tails[i], i);
+    })
+    return true;
+}
+
+
+/*
+builder: 只在list末尾追加节点, 用来线性地构建整个list.
+tail[i]是第i层最后一个节点, rank[i]是它的排名, 追加时直接用排名算出前一个节点的span,
+所有节点追加完之后再由skip_builder_finish把每一层的最后一个节点接回header.
+*/
+typedef struct skip_builder {
+    skip_node_t *tail[SKIPLIST_MAXLEVEL];
+    unsigned long rank[SKIPLIST_MAXLEVEL];
+} skip_builder_t;
+
+
+static void skip_builder_init(skip_list_t *l, skip_builder_t *b){
+    for(int i=0; i<SKIPLIST_MAXLEVEL; i++){
+        b->tail[i] = l->header;
+        SKIP_RANK(b->rank[i] = 0;)
+    }
+}
+
+
+static void skip_builder_append(skip_list_t *l, skip_builder_t *b, skip_node_t *node, int level){
+    l->length++;
+    SKIP_STATS_INC(l, inserts);
+    node->backward = b->tail[0];
+    for(int i=0; i<level; i++){
+        skip_node_t *prev = b->tail[i];
+        prev->level[i].forward = node;
+        SKIP_BACKLINK(node->level[i].backward = prev;)
+        SKIP_RANK(prev->level[i].span = l->length - b->rank[i];)
+        b->tail[i] = node;
+        SKIP_RANK(b->rank[i] = l->length;)
+    }
+    if(level > l->level){
+        l->level = level;
+    }
+}
+
+
+static void skip_builder_finish(skip_list_t *l, skip_builder_t *b){
+    for(int i=0; i<l->level; i++){
+        b->tail[i]->level[i].forward = l->header;
+        SKIP_BACKLINK(l->header->level[i].backward = b->tail[i];)
+        SKIP_RANK(b->tail[i]->level[i].span = l->length - b->rank[i];)
+        l->tail[i] = b->tail[i];
+    }
+    l->header->backward = b->tail[0];
+    //一层一层计算所有节点的聚合值, 总共O(n)
+    SKIP_AGG(for(int i=0; i<l->level; i++){
+        skip_node_t *x = l->header;
+        do{
+            skip_agg_fix(l, x, i);
+            x = x->level[i].forward;
+        }while(x != l->header);
+    })
+}
+
+
+//第pos个节点(从1开始)的层数: pos每被4整除一次就多一层, 和SKIPLIST_P = 1/4的期望分布一致
+static int sorted_level(unsigned long pos){
+    int level = 1 + __builtin_ctzl(pos)/2;
+    return (level<SKIPLIST_MAXLEVEL) ? level : SKIPLIST_MAXLEVEL;
+}
+
+
+static element_t element_load(const void *array, element_type_t type, unsigned long i){
+    element_t ele = {.u64 = 0};
+    if(array == NULL){
+        return ele;
+    }
+    switch(type){
+    case TINT32:
+        ele.i32 = ((const int32_t *)array)[i];
+        break;
+    case TUINT32:
+        ele.u32 = ((const uint32_t *)array)[i];
+        break;
+    case TINT64:
+        ele.i64 = ((const int64_t *)array)[i];
+        break;
+    case TUINT64:
+        ele.u64 = ((const uint64_t *)array)[i];
+        break;
+    case TSTR:
+        ele.s = ((char * const *)array)[i];
+        break;
+    case TPTR:
+        ele.p = ((void * const *)array)[i];
+        break;
+    case TDOUBLE:
+        ele.f = ((const double *)array)[i];
+        break;
+    default:
+        break;
+    }
+    return ele;
+}
+
+
+typedef struct run_node {
+    skip_node_t *node;
+    int level;
+} run_node_t;
+
+
+static int run_node_addr_compare(const void *a, const void *b){
+    const skip_node_t *n1 = ((const run_node_t *)a)->node;
+    const skip_node_t *n2 = ((const run_node_t *)b)->node;
+    return n1 < n2 ? -1 : (n1 == n2 ? 0 : 1);
+}
+
+
+static unsigned long skip_list_build_sorted_generic(skip_list_t *l, const void *keys, const void *values, unsigned long n, bool multi){
+    if(l->length != 0){
+        return 0;
+    }
+    for(unsigned long i=1; i<n; i++){
+        if(skip_key_compare(l, element_load(keys, l->key_type, i-1), element_load(keys, l->key_type, i)) > 0){
+            return 0;
+        }
+    }
+
+    skip_list_finger_invalidate(l);
+    skip_builder_t b;
+    skip_builder_init(l, &b);
+    run_node_t *run = NULL;
+    unsigned long run_cap = 0;
+    unsigned long i = 0;
+    while(i < n){
+        element_t key = element_load(keys, l->key_type, i);
+        unsigned long j = i+1;
+        while(j < n && skip_key_compare(l, key, element_load(keys, l->key_type, j)) == 0){
+            j++;
+        }
+        if(!multi || j-i == 1){
+            //和skip_list_insert一样, 重复的key只保留第一个
+            int level = sorted_level(l->length+1);
+            skip_node_t *node = skip_list_node_create(l, level, key, element_load(values, l->value_type, i));
+            skip_builder_append(l, &b, node, level);
+            SKIP_STATS_ADD(l, duplicates, j-i-1);
+            i = j;
+            continue;
+        }
+        //相同key的节点要按照节点地址排序, 和skip_list_insert_multi保持一致
+        if(j-i > run_cap){
+            run_cap = j-i;
+            run = realloc(run, run_cap*sizeof(*run));
+        }
+        for(unsigned long k=i; k<j; k++){
+            int level = sorted_level(l->length+1+(k-i));
+            run[k-i].node = skip_list_node_create(l, level, key, element_load(values, l->value_type, k));
+            run[k-i].level = level;
+        }
+        qsort(run, j-i, sizeof(*run), run_node_addr_compare);
+        for(unsigned long k=0; k<j-i; k++){
+            skip_builder_append(l, &b, run[k].node, run[k].level);
+        }
+        i = j;
+    }
+    free(run);
+    skip_builder_finish(l, &b);
+    return l->length;
+}
+
+
+unsigned long skip_list_build_sorted(skip_list_t *l, const void *keys, const void *values, unsigned long n){
+    return skip_list_build_sorted_generic(l, keys, values, n, false);
+}
+
+
+unsigned long skip_list_build_sorted_multi(skip_list_t *l, const void *keys, const void *values, unsigned long n){
+    return skip_list_build_sorted_generic(l, keys, values, n, true);
+}
+
+
+/*
+集合运算: 同时沿着第0层遍历a和b, 每次取出两边key最小的一段相同key的节点, 按运算决定输出哪些,
+输出的节点用builder追加到新的list末尾, 层数按位置确定, 整个过程O(n+m), 不需要任何查找.
+*/
+typedef enum skip_set_op {
+    SKIP_SET_MERGE,
+    SKIP_SET_UNION,
+    SKIP_SET_INTERSECT,
+    SKIP_SET_DIFF,
+} skip_set_op_t;
+
+
+typedef struct skip_set_out {
+    skip_list_t *l;
+    skip_builder_t b;
+    run_node_t *run; //同一个key的输出节点, 要按节点地址排序之后再追加
+    unsigned long run_len;
+    unsigned long run_cap;
+} skip_set_out_t;
+
+
+//输出node的key和value, 只能在同一段key中调用
+static void skip_set_emit(skip_set_out_t *out, skip_node_t *node){
+    if(out->run_len == out->run_cap){
+        out->run_cap = out->run_cap ? 2*out->run_cap : 16;
+        out->run = realloc(out->run, out->run_cap * sizeof(*out->run));
+    }
+    int level = sorted_level(out->l->length+1+out->run_len);
+    out->run[out->run_len].node = skip_list_node_create(out->l, level, node->key, node->value);
+    out->run[out->run_len].level = level;
+    out->run_len++;
+}
+
+
+//输出从x开始的count个节点, 返回下一个节点
+static skip_node_t *skip_set_emit_n(skip_set_out_t *out, skip_node_t *x, unsigned long count){
+    for(; count>0; count--, x=x->level[0].forward){
+        skip_set_emit(out, x);
+    }
+    return x;
+}
+
+
+static void skip_set_flush(skip_set_out_t *out){
+    if(out->run_len > 1){
+        qsort(out->run, out->run_len, sizeof(*out->run), run_node_addr_compare);
+    }
+    for(unsigned long k=0; k<out->run_len; k++){
+        skip_builder_append(out->l, &out->b, out->run[k].node, out->run[k].level);
+    }
+    out->run_len = 0;
+}
+
+
+//从x开始key相同的节点个数
+static unsigned long skip_set_run(skip_list_t *l, skip_node_t *x, element_t key){
+    unsigned long count = 0;
+    for(; x!=l->header && skip_key_compare(l, x->key, key) == 0; x=x->level[0].forward){
+        count++;
+    }
+    return count;
+}
+
+
+static skip_list_t *skip_list_set_op(skip_list_t *a, skip_list_t *b, skip_set_op_t op, bool multi){
+    if(a->key_type != b->key_type || a->value_type != b->value_type || a->compare != b->compare){
+        return NULL;
+    }
+    skip_set_out_t out = {.l = skip_list_create(a->key_type, a->value_type, a->compare, a->flags)};
+    skip_builder_init(out.l, &out.b);
+    skip_node_t *x = a->header->level[0].forward;
+    skip_node_t *y = b->header->level[0].forward;
+    while(x != a->header || y != b->header){
+        //key是两边当前最小的key, ca和cb是两边这个key的节点个数
+        int comp = x == a->header ? 1 : (y == b->header ? -1 : skip_key_compare(a, x->key, y->key));
+        element_t key = comp <= 0 ? x->key : y->key;
+        unsigned long ca = comp <= 0 ? skip_set_run(a, x, key) : 0;
+        unsigned long cb = comp >= 0 ? skip_set_run(b, y, key) : 0;
+        switch(op){
+        case SKIP_SET_MERGE:
+            skip_set_emit_n(&out, x, ca);
+            skip_set_emit_n(&out, y, cb);
+            break;
+        case SKIP_SET_UNION:
+            //multi时每个key保留max(ca, cb)个, 先取a中的; 否则只保留一个, a中有时取a的value
+            if(!multi){
+                skip_set_emit(&out, ca > 0 ? x : y);
+            }else{
+                skip_set_emit_n(&out, x, ca);
+                skip_node_t *rest = y;
+                for(unsigned long k=0; k<ca && k<cb; k++){
+                    rest = rest->level[0].forward;
+                }
+                skip_set_emit_n(&out, rest, cb > ca ? cb - ca : 0);
+            }
+            break;
+        case SKIP_SET_INTERSECT:
+            //multi时保留min(ca, cb)个, 都取a中的
+            if(ca > 0 && cb > 0){
+                skip_set_emit_n(&out, x, multi ? (ca < cb ? ca : cb) : 1);
+            }
+            break;
+        case SKIP_SET_DIFF:
+            //multi时保留ca-cb个, 取a中后面的; 否则只有b中没有的key保留一个
+            if(multi && ca > cb){
+                skip_node_t *rest = x;
+                for(unsigned long k=0; k<cb; k++){
+                    rest = rest->level[0].forward;
+                }
+                skip_set_emit_n(&out, rest, ca - cb);
+            }else if(!multi && ca > 0 && cb == 0){
+                skip_set_emit(&out, x);
+            }
+            break;
+        }
+        skip_set_flush(&out);
+        for(; ca>0; ca--){
+            x = x->level[0].forward;
+        }
+        for(; cb>0; cb--){
+            y = y->level[0].forward;
+        }
+    }
+    free(out.run);
+    skip_builder_finish(out.l, &out.b);
+    return out.l;
+}
+
+
+skip_list_t *skip_list_merge(skip_list_t *a, skip_list_t *b){
+    return skip_list_set_op(a, b, SKIP_SET_MERGE, true);
+}
+
+
+skip_list_t *skip_list_union(skip_list_t *a, skip_list_t *b, bool multi){
+    return skip_list_set_op(a, b, SKIP_SET_UNION, multi);
+}
+
+
+skip_list_t *skip_list_intersect(skip_list_t *a, skip_list_t *b, bool multi){
+    return skip_list_set_op(a, b, SKIP_SET_INTERSECT, multi);
+}
+
+
+skip_list_t *skip_list_difference(skip_list_t *a, skip_list_t *b, bool multi){
+    return skip_list_set_op(a, b, SKIP_SET_DIFF, multi);
+}
+
+
+typedef struct batch_item {
+    element_t key;
+    element_t value;
+    skip_node_t *node; //insert_multi时预先分配好的节点, 相同key按节点地址排序
+    int level;
+    unsigned long index; //在输入数组中的下标
+} batch_item_t;
+
+
+static bool batch_item_less(skip_list_t *l, const batch_item_t *a, const batch_item_t *b){
+    int comp = skip_key_compare(l, a->key, b->key);
+    return comp < 0 || (comp == 0 && a->node < b->node);
+}
+
+
+//自底向上的归并排序, 是稳定的, 这样重复key中先出现的会先插入
+static batch_item_t *batch_sort(skip_list_t *l, batch_item_t *items, batch_item_t *tmp, unsigned long n){
+    for(unsigned long width=1; width<n; width*=2){
+        for(unsigned long lo=0; lo<n; lo+=2*width){
+            unsigned long mid = lo+width < n ? lo+width : n;
+            unsigned long hi = lo+2*width < n ? lo+2*width : n;
+            unsigned long i = lo, j = mid, k = lo;
+            while(i < mid && j < hi){
+                tmp[k++] = batch_item_less(l, &items[j], &items[i]) ? items[j++] : items[i++];
+            }
+            while(i < mid){
+                tmp[k++] = items[i++];
+            }
+            while(j < hi){
+                tmp[k++] = items[j++];
+            }
+        }
+        batch_item_t *swap = items;
+        items = tmp;
+        tmp = swap;
+    }
+    return items;
+}
+
+
+static unsigned long skip_list_insert_batch_generic(skip_list_t *l, const void *keys, const void *values, unsigned long n, skip_node_t **out, bool multi){
+    batch_item_t *buf = malloc(2*n*sizeof(*buf));
+    for(unsigned long i=0; i<n; i++){
+        buf[i].key = element_load(keys, l->key_type, i);
+        buf[i].value = element_load(values, l->value_type, i);
+        buf[i].index = i;
+        buf[i].node = NULL;
+        if(multi){
+            buf[i].level = random_level();
+            buf[i].node = skip_list_node_create(l, buf[i].level, buf[i].key, buf[i].value);
+        }
+    }
+    batch_item_t *items = batch_sort(l, buf, buf+n, n);
+
+    skip_list_finger_invalidate(l);
+    skip_finger_t finger;
+    skip_finger_reset(l, &finger);
+    unsigned long inserted = 0;
+    for(unsigned long i=0; i<n; i++){
+        batch_item_t *item = &items[i];
+        skip_finger_seek(l, &finger, item->key, item->node);
+        skip_node_t *node = item->node;
+        if(!multi){
+            skip_node_t *next = finger.update[0]->level[0].forward;
+            if(next != l->header && skip_key_compare(l, next->key, item->key) == 0){
+                SKIP_STATS_INC(l, duplicates);
+                if(out != NULL){
+                    out[item->index] = NULL;
+                }
+                continue;
+            }
+            item->level = random_level();
+            node = skip_list_node_create(l, item->level, item->key, item->value);
+        }
+        skip_list_link(l, node, item->level, finger.update, finger.rank);
+        skip_finger_advance(&finger, node, item->level);
+        if(out != NULL){
+            out[item->index] = node;
+        }
+        inserted++;
+    }
+    free(buf);
+    return inserted;
+}
+
+
+unsigned long skip_list_insert_batch(skip_list_t *l, const void *keys, const void *values, unsigned long n, skip_node_t **out){
+    return skip_list_insert_batch_generic(l, keys, values, n, out, false);
+}
+
+
+unsigned long skip_list_insert_batch_multi(skip_list_t *l, const void *keys, const void *values, unsigned long n, skip_node_t **out){
+    return skip_list_insert_batch_generic(l, keys, values, n, out, true);
+}
+
+
+//按顺序查找keys, 用同一个finger从上一个key的位置继续, 先向上爬再向下走.
+//compact为true时只按顺序输出找到的节点, 否则nodes[i]/ranks[i]对应keys[i]. 返回找到的个数
+static unsigned long skip_list_seek_sorted_generic(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **nodes, unsigned long *ranks, bool compact){
+    skip_finger_t f;
+    skip_finger_reset(l, &f);
+    unsigned long found = 0;
+    for(unsigned long i=0; i<n; i++){
+        element_t key = element_load(keys, l->key_type, i);
+        skip_finger_seek(l, &f, key, NULL);
+        skip_node_t *next = f.update[0]->level[0].forward;
+        bool match = next != l->header && skip_key_compare(l, next->key, key) == 0;
+        unsigned long j = compact ? found : i;
+        if(match || !compact){
+            if(nodes != NULL){
+                nodes[j] = match ? next : NULL;
+            }
+            if(ranks != NULL){
+                ranks[j] = 0;
+                SKIP_RANK(ranks[j] = match ? f.rank[0] + 1 : 0;)
+            }
+        }
+        found += match;
+    }
+    return found;
+}
+
+
+unsigned long skip_list_seek_sorted(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **nodes, unsigned long *ranks){
+    return skip_list_seek_sorted_generic(l, keys, n, nodes, ranks, false);
+}
+
+
+unsigned long skip_list_intersect_sorted_keys(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **nodes, unsigned long *ranks){
+    return skip_list_seek_sorted_generic(l, keys, n, nodes, ranks, true);
+}
+
+
+/*
+AMAC: 同时进行AMAC_GROUP个互不依赖的查找, 每个查找是一个状态机, 每次只向前走一步:
+比较已经预取的后继, 然后预取下一个要比较的节点, 再切换到下一个查找.
+等待一个cache miss的时候其他查找可以继续, 多个cache miss可以同时进行.
+*/
+#define AMAC_GROUP 16
+
+
+typedef struct amac_state {
+    element_t key;
+    skip_prefix_t prefix;
+    skip_node_t *cur;
+    unsigned long rank;
+    unsigned long index; //在keys中的下标
+    int level;
+    bool active;
+} amac_state_t;
+
+
+//开始第index个查找, 预取它要比较的第一个节点
+static void amac_start(skip_list_t *l, amac_state_t *st, element_t key, unsigned long index){
+    st->key = key;
+    st->prefix = skip_list_key_prefix(l, key);
+    st->cur = l->header;
+    st->rank = 0;
+    st->index = index;
+    st->level = l->level-1;
+    st->active = true;
+    SKIP_STATS_INC(l, descents);
+    __builtin_prefetch(l->header->level[st->level].forward);
+}
+
+
+//nodes和ranks可以为NULL
+static void skip_list_find_batch_generic(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **nodes, unsigned long *ranks){
+    amac_state_t group[AMAC_GROUP];
+    unsigned long next = 0;
+    int active = 0;
+    for(int g=0; g<AMAC_GROUP; g++){
+        group[g].active = false;
+        if(next < n){
+            amac_start(l, &group[g], element_load(keys, l->key_type, next), next);
+            next++;
+            active++;
+        }
+    }
+    while(active > 0){
+        for(int g=0; g<AMAC_GROUP; g++){
+            amac_state_t *st = &group[g];
+            if(!st->active){
+                continue;
+            }
+            skip_node_t *x = st->cur->level[st->level].forward;
+            int comp = x == l->header ? 1 : skip_node_compare(l, x, st->key, st->prefix);
+            if(comp < 0){
+                SKIP_RANK(st->rank += st->cur->level[st->level].span;)
+                SKIP_STATS_HOP(l, st->level);
+                st->cur = x;
+                __builtin_prefetch(x->level[st->level].forward);
+                continue;
+            }
+            if(st->level > 0){
+                st->level--;
+                __builtin_prefetch(st->cur->level[st->level].forward);
+                continue;
+            }
+            //第0层的后继是第一个不小于key的节点
+            bool found = comp == 0;
+            if(nodes != NULL){
+                nodes[st->index] = found ? x : NULL;
+            }
+            if(ranks != NULL){
+                ranks[st->index] = 0;
+                SKIP_RANK(ranks[st->index] = found ? st->rank + st->cur->level[0].span : 0;)
+            }
+            if(next < n){
+                amac_start(l, st, element_load(keys, l->key_type, next), next);
+                next++;
+            }else{
+                st->active = false;
+                active--;
+            }
+        }
+    }
+}
+
+
+void skip_list_find_batch(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **out){
+    skip_list_find_batch_generic(l, keys, n, out, NULL);
+}
+
+
+void skip_list_get_rank_batch(skip_list_t *l, const void *keys, unsigned long n, unsigned long *out){
+    skip_list_find_batch_generic(l, keys, n, NULL, out);
+}
+
+
+const compare_func_t compare_func_list[TDOUBLE+1] = {
+    element_compare_i32,
+    element_compare_u32,
+    element_compare_i64,
+    element_compare_u64,
+    element_compare_s,
+    NULL,
+    element_compare_f
+};
+
+
+void skip_list_stats(skip_list_t *l, skip_list_stats_t *stats){
+#ifdef SKIPLIST_STATS
+    *stats = l->stats;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+    //count[i]为第i层的节点个数, 层数为h的节点个数是count[h-1]-count[h]
+    unsigned long count[SKIPLIST_MAXLEVEL+1] = {};
+    for(int i=0; i<l->level; i++){
+        for(skip_node_t *cur=l->header->level[i].forward; cur!=l->header; cur=cur->level[i].forward){
+            count[i]++;
+        }
+    }
+    memset(stats->level_histogram, 0, sizeof(stats->level_histogram));
+    for(int h=1; h<=SKIPLIST_MAXLEVEL; h++){
+        stats->level_histogram[h] = count[h-1] - count[h];
+    }
+}
+
+
+void skip_list_stats_reset(skip_list_t *l){
+#ifdef SKIPLIST_STATS
+    memset(&l->stats, 0, sizeof(l->stats));
+#else
+    (void)l;
+#endif
+}
@@ -23,8 +23,8 @@ typedef enum element_type {
     TINT64,
     TUINT64,
     TSTR,
-    TPTR, //从指针开始暂时不支持做key
-    TDOUBLE, // float 传参时候会转换成double, 所以不支持float
+    TPTR, //指针做key时必须用SKIP_LIST_CREATE_CUSTOM指定比较函数
+    TDOUBLE, // float 传参时候会转换成double, 所以不支持float. 做key时不能是NaN
     TUNKNOW
 } element_type_t;
 
@@ -43,8 +43,66 @@ extern char* const element_typename_list[];
 #define ELEMENT_TYPEIDNAME(typeid) ((typeid) > TUNKNOW? element_typename_list[TUNKNOW] : element_typename_list[(typeid)])
 
 
+#define SKIPLIST_MAXLEVEL 32 /* Should be enough for 2^64 elements */
+
+
+/*
+编译时定义SKIPLIST_NO_RANK时节点的每一层只有forward指针, 没有span, 插入删除不再维护排名,
+每一层从16字节变成8字节. skiplist.c和使用它的代码要用同样的定义编译.
+这时排名相关的操作(get_rank, get_node_rank, get_node_by_rank, get_nodes_by_rank, quantiles, remove_rank_range)总是返回0或者NULL,
+count_range退化为沿着第0层计数.
+
+编译时定义SKIPLIST_BACKLINKS时每一层都有指向前一个节点的backward指针, 节点中保存自己的层数,
+remove_node和get_node_rank不需要从header开始查找, 也不需要比较key, 沿着backward向上走即可.
+同样要求skiplist.c和使用它的代码用同样的定义编译.
+
+编译时定义SKIPLIST_AGGREGATE时每一层还保存(本节点, forward]之间节点的value的个数, 和, 最小值, 最大值,
+和span覆盖的是同样的节点, 由插入删除维护. key范围或者前rank个节点的聚合值可以在O(log n)内得到.
+直接修改节点的value不会更新聚合值, 要用skip_list_update_value. 同样要求用同样的定义编译.
+*/
+
+
 typedef struct skip_node skip_node_t;
 typedef struct skip_list skip_list_t;
+typedef struct skip_arena skip_arena_t;
+typedef struct skip_str_arena skip_str_arena_t;
+typedef struct skip_finger skip_finger_t;
+
+
+typedef enum skip_list_flag {
+    SKIP_LIST_ARENA = 1 << 0, //节点从list私有的arena中按层数分类分配, 删除的节点会被复用, destroy时整块释放
+    SKIP_LIST_KEY_PREFIX = 1 << 1, //字符串key: 节点中缓存key的前16个字节, 比较时前缀不同就不需要访问字符串
+    SKIP_LIST_KEY_COPY = 1 << 2, //字符串key: 插入时把key复制到list私有的字符串arena中, destroy时释放
+    SKIP_LIST_PREFETCH = 1 << 3, //查找时预取下一层的后继节点, 适合远大于cache的list
+} skip_list_flag_t;
+
+
+/*
+运行时统计: 编译时定义SKIPLIST_STATS才会计数(skiplist.c和使用它的代码要用同样的定义编译),
+否则计数器都是0, 查找路径上没有任何额外的指令.
+level_histogram不是计数器, 每次调用skip_list_stats时遍历每一层计算.
+*/
+typedef struct skip_list_stats {
+    unsigned long comparisons; //key的比较次数
+    unsigned long descents; //从上往下查找的次数
+    unsigned long hops[SKIPLIST_MAXLEVEL]; //每一层向前走的次数
+    unsigned long inserts;
+    unsigned long removes;
+    unsigned long duplicates; //因为key已经存在而没有插入的次数
+    unsigned long level_histogram[SKIPLIST_MAXLEVEL+1]; //层数为h的节点个数
+} skip_list_stats_t;
+
+
+/*
+value的聚合值. 有符号整数的sum/min/max用i64, 无符号整数用u64, double用f;
+字符串和指针的value只计数. 没有节点时min/max是对应类型的最大值/最小值.
+*/
+typedef struct skip_agg {
+    unsigned long count;
+    element_t sum;
+    element_t min;
+    element_t max;
+} skip_agg_t;
 
 
 typedef int32_t (*compare_func_t)(element_t key, element_t value);
@@ -57,11 +115,22 @@ struct skip_node {
     element_t value;
 
     skip_node_t *backward;
+#ifdef SKIPLIST_BACKLINKS
+    int height; //节点的层数, header为SKIPLIST_MAXLEVEL
+#endif
     struct skiplist_level {
         skip_node_t *forward;
+#ifdef SKIPLIST_BACKLINKS
+        skip_node_t *backward; //这一层的前一个节点, header的是这一层最后一个节点
+#endif
+#ifndef SKIPLIST_NO_RANK
         //span在节点中存放到forward节点的距离,header节点中span存放到第一个节点中的距离, level[0]最后一个节点的span应该为0
         //这样insert时候, 只需要计算backward节点和当前节点的span, 不需要计算forward节点的span. 这样可以不需要判断forward节点是否是NULL/header.
         unsigned long span; 
+#endif
+#ifdef SKIPLIST_AGGREGATE
+        skip_agg_t agg; //(本节点, forward]之间节点的value的聚合值, forward为header时到末尾
+#endif
     }level[];
 };
 
@@ -74,6 +143,18 @@ struct skip_list {
     element_type_t key_type;
     element_type_t value_type;
 
+    unsigned int flags; //skip_list_flag_t的组合, 创建时指定
+    skip_arena_t *arena; //没有SKIP_LIST_ARENA时为NULL, 节点直接malloc
+    skip_str_arena_t *str_arena; //没有SKIP_LIST_KEY_COPY时为NULL
+    skip_finger_t *finger; //hint版本的操作缓存的查找位置, 第一次使用时分配
+
+    skip_node_t *tail[SKIPLIST_MAXLEVEL]; //每一层的最后一个节点, 没有节点时是header
+    unsigned long append_fast; //skip_list_append走快速路径的次数
+    unsigned long append_fallback; //key不是最大, 退回普通插入的次数
+#ifdef SKIPLIST_STATS
+    skip_list_stats_t stats;
+#endif
+
     compare_func_t compare;
     print_element_func_t print_key;
     print_element_func_t print_value;
@@ -98,19 +179,33 @@ struct skip_list {
         for (skip_node_t *tMp__=(node)->backward; (node)!=(l)->header; (node)=tMp__, tMp__=(node)->backward)
 
 
-extern const compare_func_t compare_func_list[TSTR+1];
+//遍历key在[lo, hi)之间的节点, lo和hi是element_t
+#define skip_list_foreach_range(node, l, lo, hi) \
+        for (skip_node_t *eNd__ = skip_list_lower_bound((l), (hi)) ?: (l)->header, \
+             *bEg__ __attribute__((unused)) = (node) = ((l)->compare((lo), (hi)) < 0 ? skip_list_lower_bound((l), (lo)) ?: (l)->header : eNd__); \
+             (node)!=eNd__; (node)=(node)->level[0].forward)
+
+
+//遍历排名在[start, end]之间的节点, 排名从1开始
+#define skip_list_foreach_rank_range(node, l, start, end) \
+        for (unsigned long rAnK__ = ((node) = skip_list_get_node_by_rank((l), (start)), (start)); \
+             (node)!=NULL && (node)!=(l)->header && rAnK__<=(end); (node)=(node)->level[0].forward, rAnK__++)
+
 
-skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare);
+extern const compare_func_t compare_func_list[TDOUBLE+1]; //TPTR没有默认的比较函数, 为NULL
 
+skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_typeid, compare_func_t compare, unsigned int flags);
 
-#define SKIP_LIST_CREATE(KEY_TYPE, VALUE_TYPE) ({ \
+
+//可选的第三个参数为skip_list_flag_t的组合, 例如 SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA)
+#define SKIP_LIST_CREATE(KEY_TYPE, VALUE_TYPE, ...) ({ \
     KEY_TYPE __key__; \
     VALUE_TYPE __value__; \
     (void) __key__; \
     (void) __value__; \
     element_type_t __key_type__ = ELEMENT_TYPEID(__key__); \
     element_type_t __value_type__ = ELEMENT_TYPEID(__value__); \
-    if(__key_type__ > TSTR){ \
+    if(__key_type__ == TPTR || __key_type__ > TDOUBLE){ \
         fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
         _Exit(1); \
     } \
@@ -118,11 +213,11 @@ skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_ty
         fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
         _Exit(1); \
     } \
-    skip_list_create(__key_type__, __value_type__, compare_func_list[__key_type__]); \
+    skip_list_create(__key_type__, __value_type__, compare_func_list[__key_type__], 0 __VA_OPT__(|) __VA_ARGS__); \
 })
 
 
-#define SKIP_LIST_CREATE_CUSTOM(KEY_TYPE, VALUE_TYPE, compare_func) ({ \
+#define SKIP_LIST_CREATE_CUSTOM(KEY_TYPE, VALUE_TYPE, compare_func, ...) ({ \
     KEY_TYPE __key__; \
     VALUE_TYPE __value__; \
     (void) __key__; \
@@ -137,7 +232,7 @@ skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_ty
         fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
         _Exit(1); \
     } \
-    skip_list_create(__key_type__, __value_type__, (compare_func)); \
+    skip_list_create(__key_type__, __value_type__, (compare_func), 0 __VA_OPT__(|) __VA_ARGS__); \
 })
 
 
@@ -202,6 +297,285 @@ skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_ty
     skip_list_get_rank((list), (element_t)(key)); \
 })
 
+
+//values数组的元素类型, values为NULL(void *)时不检查, 直接返回list的value_type. 内层的choose_expr避免对void *取下标
+#define SKIP_VALUES_TYPEID(list, values) __builtin_choose_expr(__builtin_types_compatible_p(__typeof__(values), void *), \
+    (list)->value_type, \
+    ELEMENT_TYPEID(__builtin_choose_expr(__builtin_types_compatible_p(__typeof__(values), void *), (element_t *)0, (values))[0]))
+
+
+#define SKIP_LIST_BUILD_SORTED(list, keys, values, n) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    element_type_t __value_type__ = SKIP_VALUES_TYPEID((list), (values)); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_build_sorted((list), (keys), (values), (n)); \
+})
+
+
+#define SKIP_LIST_BUILD_SORTED_MULTI(list, keys, values, n) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    element_type_t __value_type__ = SKIP_VALUES_TYPEID((list), (values)); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_build_sorted_multi((list), (keys), (values), (n)); \
+})
+
+
+#define SKIP_LIST_INSERT_BATCH(list, keys, values, n, out) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    element_type_t __value_type__ = SKIP_VALUES_TYPEID((list), (values)); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_insert_batch((list), (keys), (values), (n), (out)); \
+})
+
+
+#define SKIP_LIST_INSERT_BATCH_MULTI(list, keys, values, n, out) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    element_type_t __value_type__ = SKIP_VALUES_TYPEID((list), (values)); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_insert_batch_multi((list), (keys), (values), (n), (out)); \
+})
+
+
+#define SKIP_LIST_SEEK_SORTED(list, keys, n, nodes, ranks) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_seek_sorted((list), (keys), (n), (nodes), (ranks)); \
+})
+
+
+#define SKIP_LIST_INTERSECT_SORTED_KEYS(list, keys, n, nodes, ranks) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_intersect_sorted_keys((list), (keys), (n), (nodes), (ranks)); \
+})
+
+
+#define SKIP_LIST_FIND_BATCH(list, keys, n, out) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_find_batch((list), (keys), (n), (out)); \
+})
+
+
+#define SKIP_LIST_GET_RANK_BATCH(list, keys, n, out) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID((keys)[0]); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_get_rank_batch((list), (keys), (n), (out)); \
+})
+
+#define SKIP_LIST_INSERT_HINT(list, hint, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_insert_hint((list), (hint), (element_t)(key), (element_t)(value)); \
+})
+
+
+#define SKIP_LIST_INSERT_MULTI_HINT(list, hint, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_insert_multi_hint((list), (hint), (element_t)(key), (element_t)(value)); \
+})
+
+
+#define SKIP_LIST_FIND_HINT(list, hint, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_find_hint((list), (hint), (element_t)(key)); \
+})
+
+
+#define SKIP_LIST_REMOVE_HINT(list, hint, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_remove_hint((list), (hint), (element_t)(key)); \
+})
+
+#define SKIP_LIST_APPEND(list, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_append((list), (element_t)(key), (element_t)(value)); \
+})
+
+
+#define SKIP_LIST_APPEND_MULTI(list, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_append_multi((list), (element_t)(key), (element_t)(value)); \
+})
+
+
+#define SKIP_LIST_LOWER_BOUND(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_lower_bound((list), (element_t)(key)); \
+})
+
+
+#define SKIP_LIST_UPPER_BOUND(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_upper_bound((list), (element_t)(key)); \
+})
+
+
+#define SKIP_LIST_UPDATE_KEY(list, node, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_update_key((list), (node), (element_t)(key)); \
+})
+
+
+#define SKIP_LIST_COUNT_RANGE(list, lo, hi) ({ \
+    element_type_t __lo_type__ = ELEMENT_TYPEID(lo); \
+    element_type_t __hi_type__ = ELEMENT_TYPEID(hi); \
+    if(__lo_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__lo_type__)); \
+        _Exit(1); \
+    } \
+    if(__hi_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__hi_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_count_range((list), (element_t)(lo), (element_t)(hi)); \
+})
+
+
+#define SKIP_LIST_AGGREGATE_RANGE(list, lo, hi, agg) ({ \
+    element_type_t __lo_type__ = ELEMENT_TYPEID(lo); \
+    element_type_t __hi_type__ = ELEMENT_TYPEID(hi); \
+    if(__lo_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__lo_type__)); \
+        _Exit(1); \
+    } \
+    if(__hi_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__hi_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_aggregate_range((list), (element_t)(lo), (element_t)(hi), (agg)); \
+})
+
+
+#define SKIP_LIST_UPDATE_VALUE(list, node, value) ({ \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_update_value((list), (node), (element_t)(value)); \
+})
+
+
+#define SKIP_LIST_REMOVE_RANGE(list, lo, hi) ({ \
+    element_type_t __lo_type__ = ELEMENT_TYPEID(lo); \
+    element_type_t __hi_type__ = ELEMENT_TYPEID(hi); \
+    if(__lo_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__lo_type__)); \
+        _Exit(1); \
+    } \
+    if(__hi_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__hi_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_remove_range((list), (element_t)(lo), (element_t)(hi)); \
+})
+
+
+#define SKIP_LIST_SPLIT_AT_KEY(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list_split_at_key((list), (element_t)(key)); \
+})
+
 #else
 
 #define SKIP_LIST_INSERT(list, key, value) (skip_list_insert((list), (element_t)(key), (element_t)(value)))
@@ -218,6 +592,72 @@ skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_ty
 
 #define SKIP_LIST_GET_RANK(list, key) (skip_list_get_rank((list), (element_t)(key)))
 
+
+#define SKIP_LIST_BUILD_SORTED(list, keys, values, n) (skip_list_build_sorted((list), (keys), (values), (n)))
+
+
+#define SKIP_LIST_BUILD_SORTED_MULTI(list, keys, values, n) (skip_list_build_sorted_multi((list), (keys), (values), (n)))
+
+
+#define SKIP_LIST_INSERT_BATCH(list, keys, values, n, out) (skip_list_insert_batch((list), (keys), (values), (n), (out)))
+
+
+#define SKIP_LIST_INSERT_BATCH_MULTI(list, keys, values, n, out) (skip_list_insert_batch_multi((list), (keys), (values), (n), (out)))
+
+
+#define SKIP_LIST_FIND_BATCH(list, keys, n, out) (skip_list_find_batch((list), (keys), (n), (out)))
+
+
+#define SKIP_LIST_SEEK_SORTED(list, keys, n, nodes, ranks) (skip_list_seek_sorted((list), (keys), (n), (nodes), (ranks)))
+
+
+#define SKIP_LIST_INTERSECT_SORTED_KEYS(list, keys, n, nodes, ranks) (skip_list_intersect_sorted_keys((list), (keys), (n), (nodes), (ranks)))
+
+
+#define SKIP_LIST_GET_RANK_BATCH(list, keys, n, out) (skip_list_get_rank_batch((list), (keys), (n), (out)))
+
+
+#define SKIP_LIST_INSERT_HINT(list, hint, key, value) (skip_list_insert_hint((list), (hint), (element_t)(key), (element_t)(value)))
+
+
+#define SKIP_LIST_INSERT_MULTI_HINT(list, hint, key, value) (skip_list_insert_multi_hint((list), (hint), (element_t)(key), (element_t)(value)))
+
+
+#define SKIP_LIST_FIND_HINT(list, hint, key) (skip_list_find_hint((list), (hint), (element_t)(key)))
+
+
+#define SKIP_LIST_REMOVE_HINT(list, hint, key) (skip_list_remove_hint((list), (hint), (element_t)(key)))
+
+
+#define SKIP_LIST_APPEND(list, key, value) (skip_list_append((list), (element_t)(key), (element_t)(value)))
+
+
+#define SKIP_LIST_APPEND_MULTI(list, key, value) (skip_list_append_multi((list), (element_t)(key), (element_t)(value)))
+
+
+#define SKIP_LIST_LOWER_BOUND(list, key) (skip_list_lower_bound((list), (element_t)(key)))
+
+
+#define SKIP_LIST_UPPER_BOUND(list, key) (skip_list_upper_bound((list), (element_t)(key)))
+
+
+#define SKIP_LIST_UPDATE_KEY(list, node, key) (skip_list_update_key((list), (node), (element_t)(key)))
+
+
+#define SKIP_LIST_COUNT_RANGE(list, lo, hi) (skip_list_count_range((list), (element_t)(lo), (element_t)(hi)))
+
+
+#define SKIP_LIST_AGGREGATE_RANGE(list, lo, hi, agg) (skip_list_aggregate_range((list), (element_t)(lo), (element_t)(hi), (agg)))
+
+
+#define SKIP_LIST_UPDATE_VALUE(list, node, value) (skip_list_update_value((list), (node), (element_t)(value)))
+
+
+#define SKIP_LIST_REMOVE_RANGE(list, lo, hi) (skip_list_remove_range((list), (element_t)(lo), (element_t)(hi)))
+
+
+#define SKIP_LIST_SPLIT_AT_KEY(list, key) (skip_list_split_at_key((list), (element_t)(key)))
+
 #endif //NDEBUG
 
 
@@ -233,6 +673,15 @@ skip_list_t* skip_list_create(element_type_t key_typeid, element_type_t value_ty
 #define SKIP_LIST_GET_NODE_BY_RANK(list, rank) (skip_list_get_node_by_rank((list), (rank)))
 
 
+#define SKIP_LIST_REMOVE_RANK_RANGE(list, start, end) (skip_list_remove_rank_range((list), (start), (end)))
+
+
+#define SKIP_LIST_SPLIT_AT_RANK(list, rank) (skip_list_split_at_rank((list), (rank)))
+
+
+#define SKIP_LIST_CONCAT(a, b) (skip_list_concat((a), (b)))
+
+
 void skip_list_print(skip_list_t *l);
 
 
@@ -257,9 +706,53 @@ skip_node_t *skip_list_find(skip_list_t *l, element_t ele);
 bool skip_list_remove(skip_list_t *l, element_t ele);
 
 
+//SKIPLIST_BACKLINKS时node必须在l中, 不再查找确认
 bool skip_list_remove_node(skip_list_t *l, skip_node_t *node);
 
 
+//优先队列: 删除最小/最大的节点, 把它的key和value写到key/value中(可以为NULL), list为空时返回false.
+//pop_min不需要查找, 第一个节点在每一层的前驱都是header; pop_max的前驱是每一层的最后一个节点, 不需要比较key.
+bool skip_list_pop_min(skip_list_t *l, element_t *key, element_t *value);
+
+
+bool skip_list_pop_max(skip_list_t *l, element_t *key, element_t *value);
+
+
+//删除最小的k个节点, 按顺序把它们的key和value写到keys/values中(可以为NULL), 返回删除的个数.
+//整个前缀一次从list上摘下, 每一层只修正一次, 然后沿着第0层释放节点.
+unsigned long skip_list_pop_min_n(skip_list_t *l, unsigned long k, element_t *keys, element_t *values);
+
+
+/*
+split/concat只修改切开或者接上的位置在每一层的forward, span和backward, 节点不移动, O(log n).
+split得到的新list和l的类型, 比较函数, flag相同, 并且共用l的arena(SKIP_LIST_ARENA/SKIP_LIST_KEY_COPY), 两个list都要destroy.
+SKIPLIST_NO_RANK时split要沿着第0层数出新list的长度.
+*/
+//把key不小于key的节点移到新的list中, 返回新的list
+skip_list_t *skip_list_split_at_key(skip_list_t *l, element_t key);
+
+
+//l只保留前rank个节点, 其余节点移到新的list中, 返回新的list. SKIPLIST_NO_RANK时返回NULL
+skip_list_t *skip_list_split_at_rank(skip_list_t *l, unsigned long rank);
+
+
+//把b的所有节点接到a的末尾, b变成空list(仍然要destroy). a的每个节点都必须排在b的所有节点之前(key相同时按节点地址).
+//a和b的类型, 比较函数或者arena相关的flag不同, 顺序不满足, 或者两个list的arena都还和别的list共用时返回false, 不做任何修改.
+//成功后a和b共用同一个arena
+bool skip_list_concat(skip_list_t *a, skip_list_t *b);
+
+
+//把node的key改成key, 按照skip_list_insert_multi的顺序放到新的位置上, 返回node, node不在l中时返回NULL.
+//新的key仍然在前后两个节点之间时直接修改; 否则把同一个节点摘下来再按原来的层数链接回去, 不会释放和分配节点.
+//SKIP_LIST_KEY_COPY时新的key会被复制, 原来的key的空间不回收. SKIPLIST_BACKLINKS时node必须在l中, 不再查找确认.
+skip_node_t *skip_list_update_key(skip_list_t *l, skip_node_t *node, element_t key);
+
+
+//修改node的value. SKIPLIST_AGGREGATE时同时更新包含node的每一层的聚合值, node不在l中时返回false.
+//没有SKIPLIST_AGGREGATE时不查找, SKIPLIST_BACKLINKS时也不再查找确认, 这两种情况下node必须在l中
+bool skip_list_update_value(skip_list_t *l, skip_node_t *node, element_t value);
+
+
 unsigned long skip_list_get_rank(skip_list_t *l, element_t ele);
 
 
@@ -269,4 +762,142 @@ unsigned long skip_list_get_node_rank(skip_list_t *l, skip_node_t *node);
 skip_node_t *skip_list_get_node_by_rank(skip_list_t *l, unsigned long rank);
 
 
+//一次取多个排名的节点, out[i]为排名ranks[i]的节点, 超出范围时为NULL. ranks不需要有序.
+//所有排名一起一层一层向下查找, 同一层中的查找互不依赖, cache miss可以重叠; 相邻的排名在上面几层走过同样的节点, 已经在cache中.
+void skip_list_get_nodes_by_rank(skip_list_t *l, const unsigned long *ranks, unsigned long n, skip_node_t **out);
+
+
+//百分位: out[i]为排名ceil(qs[i]*length)的节点(qs[i]在0到1之间, 超出时取第一个/最后一个), list为空时为NULL.
+//例如qs = {0.5, 0.9, 0.99, 0.999}. 和skip_list_get_nodes_by_rank一样只做一次合并的查找.
+void skip_list_quantiles(skip_list_t *l, const double *qs, unsigned long n, skip_node_t **out);
+
+
+//把最小(largest为false, 从小到大)或者最大(从大到小)的k个节点复制到out中, 返回复制的个数.
+//只沿着第0层走, 不需要查找, 也不依赖排名, 持有锁的时间只和k有关.
+unsigned long skip_list_select(skip_list_t *l, unsigned long k, bool largest, skip_node_t **out);
+
+
+//第一个key不小于ele的节点, 没有时返回NULL
+skip_node_t *skip_list_lower_bound(skip_list_t *l, element_t ele);
+
+
+//第一个key大于ele的节点, 没有时返回NULL
+skip_node_t *skip_list_upper_bound(skip_list_t *l, element_t ele);
+
+
+//key在[lo, hi)之间的节点个数, 利用span计算, O(log n). SKIPLIST_NO_RANK时为O(log n + 个数)
+unsigned long skip_list_count_range(skip_list_t *l, element_t lo, element_t hi);
+
+
+//key在[lo, hi)之间的节点的value的聚合值写到agg中, 返回节点个数.
+//SKIPLIST_AGGREGATE时合并查找路径上每一层的聚合值, O(log n); 否则沿着第0层逐个累加.
+unsigned long skip_list_aggregate_range(skip_list_t *l, element_t lo, element_t hi, skip_agg_t *agg);
+
+
+//排名在[1, rank]之间的节点(前rank个)的value的聚合值, 例如前缀和. rank超过长度时为所有节点. 返回节点个数.
+//SKIPLIST_AGGREGATE时O(log n), 否则沿着第0层逐个累加.
+unsigned long skip_list_aggregate_prefix(skip_list_t *l, unsigned long rank, skip_agg_t *agg);
+
+
+//删除key在[lo, hi)之间的所有节点, 返回删除的个数. 只查找一次, 每一层的span只修正一次.
+unsigned long skip_list_remove_range(skip_list_t *l, element_t lo, element_t hi);
+
+
+//删除排名在[start, end]之间的所有节点(排名从1开始), 返回删除的个数.
+unsigned long skip_list_remove_rank_range(skip_list_t *l, unsigned long start, unsigned long end);
+
+
+//带hint的版本, 类似std::map的emplace_hint. hint是上一次hint操作返回的节点(或者它的前一个节点)时,
+//从上一次的位置出发查找, 代价是O(log d), d是两次操作之间的排名距离; 否则和普通版本一样从header开始查找.
+//hint可以为NULL. 不带hint的修改操作会让缓存的位置失效.
+skip_node_t *skip_list_insert_hint(skip_list_t *l, skip_node_t *hint, element_t key, element_t value);
+
+
+skip_node_t *skip_list_insert_multi_hint(skip_list_t *l, skip_node_t *hint, element_t key, element_t value);
+
+
+skip_node_t *skip_list_find_hint(skip_list_t *l, skip_node_t *hint, element_t ele);
+
+
+bool skip_list_remove_hint(skip_list_t *l, skip_node_t *hint, element_t ele);
+
+
+//针对按时间顺序插入的场景: key不小于当前最大的key时直接链接到末尾, 不需要查找, 否则退回skip_list_insert.
+//l->append_fast和l->append_fallback分别记录两种情况的次数.
+skip_node_t *skip_list_append(skip_list_t *l, element_t key, element_t value);
+
+
+//同skip_list_append, 和skip_list_insert_multi语义一致.
+skip_node_t *skip_list_append_multi(skip_list_t *l, element_t key, element_t value);
+
+
+//从有序数组线性构建list, list必须为空. keys/values是元素类型与list的key_type/value_type一致的数组, values可以为NULL.
+//keys没有排好序时不做任何修改并返回0, 否则返回插入的节点个数. 重复的key只保留第一个.
+unsigned long skip_list_build_sorted(skip_list_t *l, const void *keys, const void *values, unsigned long n);
+
+
+//同skip_list_build_sorted, 但是保留重复的key, 和skip_list_insert_multi语义一致.
+unsigned long skip_list_build_sorted_multi(skip_list_t *l, const void *keys, const void *values, unsigned long n);
+
+
+/*
+集合运算: 同时沿着第0层遍历a和b, 用builder线性构建新的list, O(n+m), 不需要逐个查找插入.
+新的list和a的类型, 比较函数, flag相同, 节点复制a/b中的key和value(SKIP_LIST_KEY_COPY时key重新复制), a和b不变.
+a和b的key类型, value类型或者比较函数不同时返回NULL.
+multi为false时按集合处理, 每个key只输出一个节点; 为true时按多重集合处理重复的key, 见各个函数的说明.
+key相同时value取a中的.
+*/
+//所有节点, 保留所有重复的key
+skip_list_t *skip_list_merge(skip_list_t *a, skip_list_t *b);
+
+
+//并集, multi时每个key的个数是两边的最大值
+skip_list_t *skip_list_union(skip_list_t *a, skip_list_t *b, bool multi);
+
+
+//交集, multi时每个key的个数是两边的最小值
+skip_list_t *skip_list_intersect(skip_list_t *a, skip_list_t *b, bool multi);
+
+
+//差集a-b, multi时每个key的个数是a中的个数减去b中的个数
+skip_list_t *skip_list_difference(skip_list_t *a, skip_list_t *b, bool multi);
+
+
+//批量插入无序的数组: 先排序, 再按升序从上一个插入位置继续查找插入, 不需要每次从header开始. values可以为NULL.
+//out不为NULL时, out[i]为keys[i]对应的节点, key已经存在时为NULL(和skip_list_insert一样). 返回插入的节点个数.
+unsigned long skip_list_insert_batch(skip_list_t *l, const void *keys, const void *values, unsigned long n, skip_node_t **out);
+
+
+//同skip_list_insert_batch, 和skip_list_insert_multi语义一致.
+unsigned long skip_list_insert_batch_multi(skip_list_t *l, const void *keys, const void *values, unsigned long n, skip_node_t **out);
+
+
+//按升序查找keys(例如两个索引的merge join): nodes[i]为keys[i]对应的节点, ranks[i]为它的排名, 没有找到时为NULL/0.
+//每个key从上一个key的位置出发, 先向上爬到需要的层再向下走, m个key的代价是O(m log(n/m)).
+//keys无序时结果仍然正确, 只是没有这个优势. nodes和ranks可以为NULL, SKIPLIST_NO_RANK时排名都是0. 返回找到的个数.
+unsigned long skip_list_seek_sorted(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **nodes, unsigned long *ranks);
+
+
+//同skip_list_seek_sorted, 但是只按顺序输出找到的节点和排名(交集), 返回交集的大小
+unsigned long skip_list_intersect_sorted_keys(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **nodes, unsigned long *ranks);
+
+
+//批量查找互不相关的key: out[i]为keys[i]对应的节点, 没有找到时为NULL. keys不需要有序.
+//同时进行多个查找, 每个查找走一步之后预取下一个要比较的节点并切换到另一个查找, 多个cache miss可以重叠.
+void skip_list_find_batch(skip_list_t *l, const void *keys, unsigned long n, skip_node_t **out);
+
+
+//同skip_list_find_batch, out[i]为keys[i]的排名, 没有找到时为0. SKIPLIST_NO_RANK时都是0
+void skip_list_get_rank_batch(skip_list_t *l, const void *keys, unsigned long n, unsigned long *out);
+
+
+
+//把list的统计复制到stats中, 同时计算当前的层数分布
+void skip_list_stats(skip_list_t *l, skip_list_stats_t *stats);
+
+
+//计数器清零
+void skip_list_stats_reset(skip_list_t *l);
+
+
 #endif //ifndef SKIPLIST_H
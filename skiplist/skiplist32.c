@@ -0,0 +1,236 @@
+/*
+32位下标的紧凑skiplist, 结构和skiplist.c中的一样, 只是节点之间用下标连接.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "skiplist32.h"
+
+
+#define SKIPLIST32_P 0.25
+#define SKIP32_INIT_CAP 1024 //初始的4字节个数
+#define SKIP32_MAX_CAP ((size_t)UINT32_MAX + 1) //下标是32位的
+
+
+#define SKIP32_NODE_WORDS(level) ((sizeof(skip32_node_t) + (level)*sizeof(struct skip32_level)) / sizeof(uint32_t))
+
+
+static int random_level32(void) {
+    static const int threshold = SKIPLIST32_P*RAND_MAX;
+    int level = 1;
+    while (rand() < threshold)
+        level += 1;
+    return (level<SKIPLIST_MAXLEVEL) ? level : SKIPLIST_MAXLEVEL;
+}
+
+
+//优先复用同样层数的空闲节点, 否则从mem末尾切出一个, mem不够时按2倍扩大. 下标用完时返回0
+static uint32_t skip32_alloc(skip_list32_t *l, int level){
+    uint32_t idx = l->free_list[level];
+    if(idx != 0){
+        l->free_list[level] = SKIP_LIST32_NODE(l, idx)->backward;
+        return idx;
+    }
+    size_t words = SKIP32_NODE_WORDS(level);
+    if(l->used + words > l->cap){
+        if(l->used + words > SKIP32_MAX_CAP){
+            return 0;
+        }
+        size_t cap = l->cap * 2 < SKIP32_MAX_CAP ? l->cap * 2 : SKIP32_MAX_CAP;
+        uint32_t *mem = realloc(l->mem, cap * sizeof(uint32_t));
+        if(mem == NULL){
+            return 0;
+        }
+        l->mem = mem;
+        l->cap = cap;
+    }
+    idx = l->used;
+    l->used += words;
+    return idx;
+}
+
+
+skip_list32_t *skip_list32_create(element_type_t key_typeid, element_type_t value_typeid){
+    skip_list32_t *l = calloc(1, sizeof(*l));
+    l->cap = SKIP32_INIT_CAP;
+    l->mem = malloc(l->cap * sizeof(uint32_t));
+    l->used = SKIP32_NODE_WORDS(SKIPLIST_MAXLEVEL);
+    l->level = 1;
+    l->key_flip = key_typeid == TINT32 ? 0x80000000u : 0;
+    l->key_type = key_typeid;
+    l->value_type = value_typeid;
+    skip32_node_t *header = SKIP_LIST32_NODE(l, 0);
+    header->key = 0;
+    header->value = 0;
+    header->backward = 0;
+    for(int i=0; i<SKIPLIST_MAXLEVEL; i++){
+        header->level[i].forward = 0;
+        header->level[i].span = 0;
+    }
+    return l;
+}
+
+
+void skip_list32_destroy(skip_list32_t *l){
+    free(l->mem);
+    free(l);
+}
+
+
+uint32_t skip_list32_insert(skip_list32_t *l, uint32_t key, uint32_t value){
+    key ^= l->key_flip;
+    uint32_t update[SKIPLIST_MAXLEVEL];
+    uint32_t rank[SKIPLIST_MAXLEVEL];
+    uint32_t cur = 0;
+    for(int i=l->level-1; i>=0; i--){
+        rank[i] = i == (l->level-1) ? 0 : rank[i+1];
+        for(;;){
+            skip32_node_t *x = SKIP_LIST32_NODE(l, cur);
+            uint32_t next = x->level[i].forward;
+            if(next == 0){
+                break;
+            }
+            uint32_t next_key = SKIP_LIST32_NODE(l, next)->key;
+            if(next_key < key){
+                rank[i] += x->level[i].span;
+                cur = next;
+            }else if(next_key == key){
+                return 0;
+            }else{
+                break;
+            }
+        }
+        update[i] = cur;
+    }
+    int level = random_level32();
+    //分配可能会移动mem, 之后才能取节点的指针
+    uint32_t idx = skip32_alloc(l, level);
+    if(idx == 0){
+        return 0;
+    }
+    if(level > l->level){
+        for(int i=l->level; i<level; i++){
+            rank[i] = 0;
+            update[i] = 0;
+            SKIP_LIST32_NODE(l, 0)->level[i].span = l->length;
+        }
+        l->level = level;
+    }
+    skip32_node_t *node = SKIP_LIST32_NODE(l, idx);
+    node->key = key;
+    node->value = value;
+    for(int i=0; i<level; i++){
+        skip32_node_t *prev = SKIP_LIST32_NODE(l, update[i]);
+        node->level[i].forward = prev->level[i].forward;
+        prev->level[i].forward = idx;
+        node->level[i].span = prev->level[i].span - (rank[0] - rank[i]);
+        prev->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+    node->backward = update[0];
+    SKIP_LIST32_NODE(l, node->level[0].forward)->backward = idx;
+    for(int i=level; i<l->level; i++){
+        SKIP_LIST32_NODE(l, update[i])->level[i].span++;
+    }
+    l->length++;
+    return idx;
+}
+
+
+uint32_t skip_list32_find(skip_list32_t *l, uint32_t key){
+    key ^= l->key_flip;
+    skip32_node_t *cur = SKIP_LIST32_NODE(l, 0);
+    for(int i=l->level-1; i>=0; i--){
+        for(uint32_t next=cur->level[i].forward; next!=0; next=cur->level[i].forward){
+            skip32_node_t *x = SKIP_LIST32_NODE(l, next);
+            if(x->key >= key){
+                break;
+            }
+            cur = x;
+        }
+    }
+    uint32_t next = cur->level[0].forward;
+    return next != 0 && SKIP_LIST32_NODE(l, next)->key == key ? next : 0;
+}
+
+
+bool skip_list32_remove(skip_list32_t *l, uint32_t key){
+    key ^= l->key_flip;
+    skip32_node_t *update[SKIPLIST_MAXLEVEL];
+    skip32_node_t *cur = SKIP_LIST32_NODE(l, 0);
+    for(int i=l->level-1; i>=0; i--){
+        for(uint32_t next=cur->level[i].forward; next!=0; next=cur->level[i].forward){
+            skip32_node_t *x = SKIP_LIST32_NODE(l, next);
+            if(x->key >= key){
+                break;
+            }
+            cur = x;
+        }
+        update[i] = cur;
+    }
+    uint32_t idx = cur->level[0].forward;
+    if(idx == 0 || SKIP_LIST32_NODE(l, idx)->key != key){
+        return false;
+    }
+    //节点里面没有保存层数, 摘除时数出它在几层中出现
+    skip32_node_t *node = SKIP_LIST32_NODE(l, idx);
+    int level = 0;
+    for(int i=0; i<l->level; i++){
+        skip32_node_t *prev = update[i];
+        if(prev->level[i].forward == idx){
+            prev->level[i].span += node->level[i].span - 1;
+            prev->level[i].forward = node->level[i].forward;
+            level++;
+        }else{
+            prev->level[i].span--;
+        }
+    }
+    SKIP_LIST32_NODE(l, node->level[0].forward)->backward = node->backward;
+    l->length--;
+    while(l->level>1 && SKIP_LIST32_NODE(l, 0)->level[l->level-1].forward == 0){
+        l->level--;
+    }
+    node->backward = l->free_list[level];
+    l->free_list[level] = idx;
+    return true;
+}
+
+
+uint32_t skip_list32_get_rank(skip_list32_t *l, uint32_t key){
+    key ^= l->key_flip;
+    uint32_t rank = 0;
+    skip32_node_t *cur = SKIP_LIST32_NODE(l, 0);
+    for(int i=l->level-1; i>=0; i--){
+        for(uint32_t next=cur->level[i].forward; next!=0; next=cur->level[i].forward){
+            skip32_node_t *x = SKIP_LIST32_NODE(l, next);
+            if(x->key >= key){
+                break;
+            }
+            rank += cur->level[i].span;
+            cur = x;
+        }
+    }
+    uint32_t next = cur->level[0].forward;
+    return next != 0 && SKIP_LIST32_NODE(l, next)->key == key ? rank + cur->level[0].span : 0;
+}
+
+
+uint32_t skip_list32_get_node_by_rank(skip_list32_t *l, uint32_t rank){
+    if(rank == 0 || rank > l->length){
+        return 0;
+    }
+    uint32_t traversed = 0;
+    uint32_t idx = 0;
+    for(int i=l->level-1; i>=0; i--){
+        skip32_node_t *cur = SKIP_LIST32_NODE(l, idx);
+        while(cur->level[i].forward != 0 && traversed + cur->level[i].span <= rank){
+            traversed += cur->level[i].span;
+            idx = cur->level[i].forward;
+            cur = SKIP_LIST32_NODE(l, idx);
+        }
+        if(traversed == rank){
+            return idx;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#ifndef SKIPLIST32_H
+#define SKIPLIST32_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "skiplist.h"
+
+/*
+紧凑的32位skiplist: key和value都是int32_t/uint32_t, 按原本的宽度存放.
+所有节点放在list私有的一块连续内存中, forward/backward/span都是32位的,
+forward和backward存放节点在这块内存中的下标(以4字节为单位), 0是header, 同时表示链表结束.
+一个1层的节点只有20字节, 普通skiplist的同样节点是40字节.
+内存不够时整块realloc, 所以节点的指针在插入之后可能失效, 只能保存下标, 用SKIP_LIST32_NODE取得节点.
+下标是32位的, 整块内存最多2^32个4字节(16GB), 按平均每个节点5.7个4字节计算, 可以存放大约7亿个节点.
+key不能重复, 支持排名.
+*/
+
+typedef struct skip32_node skip32_node_t;
+typedef struct skip_list32 skip_list32_t;
+
+
+struct skip32_node {
+    uint32_t key; //int32_t的key最高位取反后存放, 这样按无符号数比较的顺序和有符号数一致
+    uint32_t value;
+    uint32_t backward; //前一个节点, header的backward是最后一个节点. 删除之后用来串起同样层数的空闲节点
+    struct skip32_level {
+        uint32_t forward;
+        uint32_t span; //含义和skip_node_t中的span相同
+    }level[];
+};
+
+
+struct skip_list32 {
+    uint32_t *mem; //所有节点所在的内存, 下标0是header
+    size_t used; //已经分配出去的4字节个数
+    size_t cap;
+    uint32_t free_list[SKIPLIST_MAXLEVEL+1]; //按层数分类的空闲节点
+    uint32_t length;
+    int level;
+    uint32_t key_flip; //int32_t的key为0x80000000, 否则为0
+
+    element_type_t key_type;
+    element_type_t value_type;
+};
+
+
+#define SKIP_LIST32_NODE(l, idx) ((skip32_node_t *)((l)->mem + (idx)))
+
+
+//取出节点中按原来的类型解释的key
+#define SKIP_LIST32_KEY(l, idx) (SKIP_LIST32_NODE((l), (idx))->key ^ (l)->key_flip)
+
+
+#define skip_list32_foreach(idx, l) \
+        for ((idx) = SKIP_LIST32_NODE((l), 0)->level[0].forward; (idx)!=0; (idx)=SKIP_LIST32_NODE((l), (idx))->level[0].forward)
+
+
+skip_list32_t *skip_list32_create(element_type_t key_typeid, element_type_t value_typeid);
+
+
+#define SKIP_LIST32_CREATE(KEY_TYPE, VALUE_TYPE) ({ \
+    KEY_TYPE __key__; \
+    VALUE_TYPE __value__; \
+    (void) __key__; \
+    (void) __value__; \
+    element_type_t __key_type__ = ELEMENT_TYPEID(__key__); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(__value__); \
+    if(__key_type__ != TINT32 && __key_type__ != TUINT32){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != TINT32 && __value_type__ != TUINT32){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list32_create(__key_type__, __value_type__); \
+})
+
+
+#ifndef NDEBUG
+
+#define SKIP_LIST32_INSERT(list, key, value) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    element_type_t __value_type__ = ELEMENT_TYPEID(value); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    if(__value_type__ != (list)->value_type){ \
+        fprintf(stderr, "%s: line %d value type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__value_type__)); \
+        _Exit(1); \
+    } \
+    skip_list32_insert((list), (uint32_t)(key), (uint32_t)(value)); \
+})
+
+
+#define SKIP_LIST32_FIND(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list32_find((list), (uint32_t)(key)); \
+})
+
+
+#define SKIP_LIST32_REMOVE(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list32_remove((list), (uint32_t)(key)); \
+})
+
+
+#define SKIP_LIST32_GET_RANK(list, key) ({ \
+    element_type_t __key_type__ = ELEMENT_TYPEID(key); \
+    if(__key_type__ != (list)->key_type){ \
+        fprintf(stderr, "%s: line %d key type (%s) error\n", __func__, __LINE__, ELEMENT_TYPEIDNAME(__key_type__)); \
+        _Exit(1); \
+    } \
+    skip_list32_get_rank((list), (uint32_t)(key)); \
+})
+
+#else
+
+#define SKIP_LIST32_INSERT(list, key, value) (skip_list32_insert((list), (uint32_t)(key), (uint32_t)(value)))
+
+
+#define SKIP_LIST32_FIND(list, key) (skip_list32_find((list), (uint32_t)(key)))
+
+
+#define SKIP_LIST32_REMOVE(list, key) (skip_list32_remove((list), (uint32_t)(key)))
+
+
+#define SKIP_LIST32_GET_RANK(list, key) (skip_list32_get_rank((list), (uint32_t)(key)))
+
+#endif //NDEBUG
+
+
+#define SKIP_LIST32_DESTROY(list) do{ skip_list32_destroy((list)); (list)=NULL; } while(0)
+
+
+#define SKIP_LIST32_GET_NODE_BY_RANK(list, rank) (skip_list32_get_node_by_rank((list), (rank)))
+
+
+void skip_list32_destroy(skip_list32_t *l);
+
+
+//返回新节点的下标, key已经存在或者下标用完时返回0
+uint32_t skip_list32_insert(skip_list32_t *l, uint32_t key, uint32_t value);
+
+
+//返回节点的下标, 没有找到时返回0
+uint32_t skip_list32_find(skip_list32_t *l, uint32_t key);
+
+
+bool skip_list32_remove(skip_list32_t *l, uint32_t key);
+
+
+//排名从1开始, 没有找到时返回0
+uint32_t skip_list32_get_rank(skip_list32_t *l, uint32_t key);
+
+
+//返回排名为rank的节点的下标, 超出范围时返回0
+uint32_t skip_list32_get_node_by_rank(skip_list32_t *l, uint32_t rank);
+
+
+#endif //ifndef SKIPLIST32_H
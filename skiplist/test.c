@@ -1,10 +1,15 @@
 #define NDEBUG
 
 #include "skiplist.h"
+#include "lf_skiplist.h"
+#include "sharded_skiplist.h"
+#include "skiplist32.h"
+#include "zset.h"
 
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 
 #define K 1000
@@ -42,31 +47,700 @@ void test_int32(){
     SKIP_LIST_DESTROY(i32_skiplist);
 }
 
-void test_uint32_bench(){
+void test_arena(){
     fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
 
-    uint32_t *data = malloc(sizeof(uint32_t) * 10 * M);
-    for(int i=0; i<10*M; i++){
-        data[i] = rand();
+    skip_list_t *i32_skiplist = SKIP_LIST_CREATE(int32_t, int32_t, SKIP_LIST_ARENA);
+
+    for(int i=0; i<20; i++){
+        SKIP_LIST_INSERT_MULTI(i32_skiplist, i % 10, i);
+    }
+    for(int i=0; i<10; i+=2){
+        SKIP_LIST_REMOVE(i32_skiplist, i);
+    }
+    //删除的节点会被重新利用
+    for(int i=100; i<105; i++){
+        SKIP_LIST_INSERT(i32_skiplist, i, -i);
+    }
+    skip_list_rank_print(i32_skiplist);
+
+    SKIP_LIST_DESTROY(i32_skiplist);
+}
+
+void test_build_sorted(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    int32_t keys[20], values[20];
+    for(int i=0; i<20; i++){
+        keys[i] = i/2;
+        values[i] = -i;
+    }
+
+    skip_list_t *i32_skiplist = SKIP_LIST_CREATE(int32_t, int32_t);
+    unsigned long n = SKIP_LIST_BUILD_SORTED(i32_skiplist, keys, values, 20);
+    printf("build sorted: %lu nodes\n", n);
+    skip_list_rank_print(i32_skiplist);
+    SKIP_LIST_DESTROY(i32_skiplist);
+
+    i32_skiplist = SKIP_LIST_CREATE(int32_t, int32_t, SKIP_LIST_ARENA);
+    n = SKIP_LIST_BUILD_SORTED_MULTI(i32_skiplist, keys, NULL, 20);
+    printf("build sorted multi (values NULL): %lu nodes\n", n);
+    SKIP_LIST_INSERT_MULTI(i32_skiplist, 5, 1234);
+    skip_list_rank_print(i32_skiplist);
+    SKIP_LIST_DESTROY(i32_skiplist);
+}
+
+void test_insert_batch(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    static char * const words[] = {
+        "zsh", "bash", "fish", "bash", "csh", "ksh", "dash", "fish"
+    };
+    int32_t values[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    skip_node_t *nodes[8];
+
+    skip_list_t *str_skiplist = SKIP_LIST_CREATE(char *, int32_t);
+    SKIP_LIST_INSERT(str_skiplist, "ksh", -1);
+    unsigned long n = SKIP_LIST_INSERT_BATCH(str_skiplist, words, values, 8, nodes);
+    printf("insert batch: %lu nodes\n", n);
+    for(int i=0; i<8; i++){
+        printf("%s: %s\n", words[i], nodes[i] != NULL ? "ok" : "exists");
+    }
+    skip_list_rank_print(str_skiplist);
+    SKIP_LIST_DESTROY(str_skiplist);
+
+    str_skiplist = SKIP_LIST_CREATE(char *, int32_t);
+    n = SKIP_LIST_INSERT_BATCH_MULTI(str_skiplist, words, NULL, 8, NULL);
+    printf("insert batch multi (values NULL): %lu nodes\n", n);
+    skip_list_print(str_skiplist);
+    SKIP_LIST_DESTROY(str_skiplist);
+}
+
+void test_hint(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    skip_list_t *i32_skiplist = SKIP_LIST_CREATE(int32_t, int32_t);
+    for(int i=0; i<100; i+=10){
+        SKIP_LIST_INSERT(i32_skiplist, i, i);
+    }
+
+    //每次都在上一个位置附近操作, 把返回的节点作为下一次的hint
+    skip_node_t *hint = NULL;
+    for(int i=41; i<50; i+=2){
+        hint = SKIP_LIST_INSERT_HINT(i32_skiplist, hint, i, -i);
+    }
+    hint = SKIP_LIST_INSERT_MULTI_HINT(i32_skiplist, hint, 45, 45);
+    hint = SKIP_LIST_FIND_HINT(i32_skiplist, hint, 43);
+    printf("find hint 43: %s\n", hint != NULL ? "found" : "not found");
+    printf("remove hint 40: %s\n", SKIP_LIST_REMOVE_HINT(i32_skiplist, hint, 40) ? "ok" : "failed");
+    printf("remove hint 42: %s\n", SKIP_LIST_REMOVE_HINT(i32_skiplist, hint, 42) ? "ok" : "failed");
+    skip_list_rank_print(i32_skiplist);
+    printf("SKIP_LIST_GET_RANK(45) == %lu\n", SKIP_LIST_GET_RANK(i32_skiplist, 45));
+
+    SKIP_LIST_DESTROY(i32_skiplist);
+}
+
+void test_append(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    skip_list_t *u64_skiplist = SKIP_LIST_CREATE(uint64_t, int32_t);
+    uint64_t ts = 1000;
+    for(int i=0; i<20; i++){
+        ts += rand() % 3;
+        SKIP_LIST_APPEND_MULTI(u64_skiplist, ts, i);
+    }
+    //乱序的key退回普通插入
+    SKIP_LIST_APPEND(u64_skiplist, (uint64_t)1005, -1);
+    SKIP_LIST_APPEND(u64_skiplist, ts+1, -2);
+    skip_list_rank_print(u64_skiplist);
+    printf("append fast %lu, fallback %lu\n", u64_skiplist->append_fast, u64_skiplist->append_fallback);
+
+    SKIP_LIST_DESTROY(u64_skiplist);
+}
+
+void test_range(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    skip_list_t *i32_skiplist = SKIP_LIST_CREATE(int32_t, int32_t);
+    for(int i=0; i<30; i++){
+        SKIP_LIST_INSERT_MULTI(i32_skiplist, i/2, i);
+    }
+
+    printf("count [3, 7) == %lu\n", SKIP_LIST_COUNT_RANGE(i32_skiplist, 3, 7));
+    printf("lower_bound(5) rank == %lu\n", SKIP_LIST_GET_NODE_RANK(i32_skiplist, SKIP_LIST_LOWER_BOUND(i32_skiplist, 5)));
+    printf("upper_bound(5) rank == %lu\n", SKIP_LIST_GET_NODE_RANK(i32_skiplist, SKIP_LIST_UPPER_BOUND(i32_skiplist, 5)));
+
+    skip_node_t *node;
+    printf("key range [3, 7): ");
+    skip_list_foreach_range(node, i32_skiplist, (element_t)3, (element_t)7){
+        printf("%d(v%d)-", node->key.i32, node->value.i32);
+    }
+    printf("\nrank range [1, 5]: ");
+    skip_list_foreach_rank_range(node, i32_skiplist, 1, 5){
+        printf("%d(v%d)-", node->key.i32, node->value.i32);
+    }
+    printf("\n");
+
+    //滑动窗口: 淘汰旧的key
+    printf("remove [0, 4): %lu\n", SKIP_LIST_REMOVE_RANGE(i32_skiplist, 0, 4));
+    printf("remove rank [10, 100]: %lu\n", SKIP_LIST_REMOVE_RANK_RANGE(i32_skiplist, 10, 100));
+    skip_list_rank_print(i32_skiplist);
+
+    SKIP_LIST_DESTROY(i32_skiplist);
+}
+
+#define LF_THREADS 4
+#define LF_KEYS 4096
+
+static lf_skip_list_t *lf_list;
+
+//每个线程只插入/删除模LF_THREADS等于自己编号的key, 结束时这些key是否存在是确定的
+static void *lf_worker(void *arg){
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    bool present[LF_KEYS / LF_THREADS] = {0};
+    uint32_t seed = id + 1;
+    for(int i=0; i<M; i++){
+        seed = seed * 1103515245 + 12345;
+        uint32_t key = (seed >> 8) % LF_KEYS;
+        element_t value;
+        if(key % LF_THREADS != id){
+            //其他线程的key只读
+            if(LF_SKIP_LIST_FIND(lf_list, key, &value) && value.u32 != key * 2){
+                printf("lf_skiplist: key %u value %u error\n", key, value.u32);
+            }
+            continue;
+        }
+        bool *p = &present[key / LF_THREADS];
+        if(*p){
+            if(!LF_SKIP_LIST_REMOVE(lf_list, key)) printf("lf_skiplist: remove %u failed\n", key);
+        }else{
+            if(!LF_SKIP_LIST_INSERT(lf_list, key, key * 2)) printf("lf_skiplist: insert %u failed\n", key);
+        }
+        *p = !*p;
+    }
+    unsigned long count = 0;
+    for(uint32_t k=id; k<LF_KEYS; k+=LF_THREADS){
+        bool found = LF_SKIP_LIST_FIND(lf_list, k, NULL);
+        if(found != present[k / LF_THREADS]) printf("lf_skiplist: key %u state error\n", k);
+        count += found;
+    }
+    lf_skip_list_thread_exit();
+    return (void *)(uintptr_t)count;
+}
+
+#define SHARDED_THREADS 4
+#define SHARDED_KEYS (1 << 18)
+#define SHARDED_OPS (256 * K)
+
+static sharded_skip_list_t *sharded_list;
+
+//和lf_worker一样每个线程只修改模SHARDED_THREADS等于自己编号的key, 先顺序插入, 再随机删除插入, shard会随着插入split
+static void *sharded_worker(void *arg){
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    bool *present = calloc(SHARDED_KEYS / SHARDED_THREADS, sizeof(bool));
+    for(uint32_t key=id; key<SHARDED_KEYS; key+=SHARDED_THREADS){
+        present[key / SHARDED_THREADS] = SHARDED_SKIP_LIST_INSERT(sharded_list, key, key * 2);
+    }
+    uint32_t seed = id + 1;
+    for(int i=0; i<SHARDED_OPS; i++){
+        seed = seed * 1103515245 + 12345;
+        uint32_t key = (seed >> 4) % SHARDED_KEYS;
+        element_t value;
+        if(key % SHARDED_THREADS != id){
+            if(SHARDED_SKIP_LIST_FIND(sharded_list, key, &value) && value.u32 != key * 2){
+                printf("sharded_skiplist: key %u value %u error\n", key, value.u32);
+            }
+            continue;
+        }
+        bool *p = &present[key / SHARDED_THREADS];
+        if(*p){
+            if(!SHARDED_SKIP_LIST_REMOVE(sharded_list, key)) printf("sharded_skiplist: remove %u failed\n", key);
+        }else{
+            if(!SHARDED_SKIP_LIST_INSERT(sharded_list, key, key * 2)) printf("sharded_skiplist: insert %u failed\n", key);
+        }
+        *p = !*p;
+    }
+    unsigned long count = 0;
+    for(uint32_t k=id; k<SHARDED_KEYS; k+=SHARDED_THREADS){
+        bool found = SHARDED_SKIP_LIST_FIND(sharded_list, k, NULL);
+        if(found != present[k / SHARDED_THREADS]) printf("sharded_skiplist: key %u state error\n", k);
+        count += found;
+    }
+    free(present);
+    return (void *)(uintptr_t)count;
+}
+
+void test_key_prefix(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //路径形式的key, 字符串在list外面, 查找时每次比较都要多访问一次内存
+    int n = 1*M;
+    char **keys = malloc(n * sizeof(char *));
+    for(int i=0; i<n; i++){
+        keys[i] = malloc(48);
+        sprintf(keys[i], "/srv/%04x/%08x/index.html", rand() % 0x10000, rand());
+    }
+
+    static const unsigned flags[] = {0, SKIP_LIST_KEY_PREFIX, SKIP_LIST_KEY_PREFIX | SKIP_LIST_ARENA};
+    static const char * const names[] = {"none", "prefix", "prefix+arena"};
+    for(int f=0; f<3; f++){
+        skip_list_t *str_skiplist = SKIP_LIST_CREATE(char *, uint32_t, flags[f]);
+        for(int i=0; i<n; i++){
+            SKIP_LIST_INSERT(str_skiplist, keys[i], (uint32_t)i);
+        }
+        unsigned long found = 0;
+        clock_t begin = clock();
+        for(int i=0; i<n; i++){
+            found += SKIP_LIST_FIND(str_skiplist, keys[(i * 7919L) % n]) != NULL;
+        }
+        printf("%s: find %lu keys: %f\n", names[f], found, (double)(clock()-begin)/CLOCKS_PER_SEC);
+        SKIP_LIST_DESTROY(str_skiplist);
+    }
+
+    //复制key之后原来的字符串可以释放
+    skip_list_t *copy_skiplist = SKIP_LIST_CREATE(char *, uint32_t, SKIP_LIST_KEY_COPY | SKIP_LIST_KEY_PREFIX);
+    char buf[32];
+    for(int i=0; i<10; i++){
+        sprintf(buf, "key-%d", i * 7 % 10);
+        SKIP_LIST_INSERT(copy_skiplist, buf, (uint32_t)i);
+    }
+    skip_list_print(copy_skiplist);
+    printf("find key-3: %s\n", SKIP_LIST_FIND(copy_skiplist, "key-3") != NULL ? "ok" : "failed");
+    SKIP_LIST_DESTROY(copy_skiplist);
+
+    for(int i=0; i<n; i++){
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+void test_prefetch(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //打开和关闭预取的结果应该完全一样, 性能用./bench --flags=prefetch测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA);
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT(u32_skiplist, (uint32_t)rand(), (uint32_t)i);
+    }
+    skip_list_t *prefetch_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA | SKIP_LIST_PREFETCH);
+    unsigned long mismatch = 0;
+    for(int i=0; i<n; i++){
+        uint32_t key = (uint32_t)rand();
+        bool exists = SKIP_LIST_FIND(prefetch_skiplist, key) != NULL;
+        mismatch += exists == (SKIP_LIST_INSERT(prefetch_skiplist, key, 0U) != NULL);
+    }
+    SKIP_LIST_DESTROY(prefetch_skiplist);
+    for(int i=0; i<n; i++){
+        uint32_t key = (uint32_t)rand();
+        unsigned long rank = (unsigned long)rand() % u32_skiplist->length + 1;
+        u32_skiplist->flags &= ~SKIP_LIST_PREFETCH;
+        skip_node_t *found = SKIP_LIST_FIND(u32_skiplist, key);
+        skip_node_t *by_rank = SKIP_LIST_GET_NODE_BY_RANK(u32_skiplist, rank);
+        u32_skiplist->flags |= SKIP_LIST_PREFETCH;
+        mismatch += found != SKIP_LIST_FIND(u32_skiplist, key);
+        mismatch += by_rank != SKIP_LIST_GET_NODE_BY_RANK(u32_skiplist, rank);
+    }
+    printf("%d elements, prefetch on/off mismatch %lu\n", n, mismatch);
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_stats(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //计数器只有用-DSKIPLIST_STATS编译时才会增加, 层数分布总是可以得到
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    for(int i=0; i<100*K; i++){
+        SKIP_LIST_INSERT(u32_skiplist, (uint32_t)(rand() % (200*K)), 0U);
+    }
+    skip_list_stats_reset(u32_skiplist);
+    for(int i=0; i<10*K; i++){
+        SKIP_LIST_FIND(u32_skiplist, (uint32_t)(rand() % (200*K)));
+    }
+
+    skip_list_stats_t stats;
+    skip_list_stats(u32_skiplist, &stats);
+    printf("length %lu, comparisons %lu, descents %lu, inserts %lu, removes %lu, duplicates %lu\n", u32_skiplist->length,
+            stats.comparisons, stats.descents, stats.inserts, stats.removes, stats.duplicates);
+    for(int i=0; i<u32_skiplist->level; i++){
+        printf("level %d: nodes %lu, hops %lu\n", i+1, stats.level_histogram[i+1], stats.hops[i]);
+    }
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_no_rank(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //用-DSKIPLIST_NO_RANK编译时每一层只有forward指针, 排名相关的操作返回0/NULL, count_range仍然可用
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA);
+    for(uint32_t i=0; i<100; i++){
+        SKIP_LIST_INSERT(u32_skiplist, i, i);
+    }
+    printf("level size %zu, get_rank(50) == %lu, get_node_by_rank(50) %s, count [10, 20) == %lu\n",
+            sizeof(struct skiplist_level), SKIP_LIST_GET_RANK(u32_skiplist, 50U),
+            SKIP_LIST_GET_NODE_BY_RANK(u32_skiplist, 50) ? "found" : "NULL", SKIP_LIST_COUNT_RANGE(u32_skiplist, 10U, 20U));
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_node_handle(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //用节点指针求排名和删除, key大量重复. 用-DSKIPLIST_BACKLINKS编译时不需要从header查找, 性能用./bench --case=node_handle测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA);
+    skip_node_t **nodes = malloc(n * sizeof(*nodes));
+    for(int i=0; i<n; i++){
+        nodes[i] = SKIP_LIST_INSERT_MULTI(u32_skiplist, (uint32_t)(rand() % 100), (uint32_t)i);
+    }
+    //SKIPLIST_NO_RANK时get_node_rank总是返回0
+    unsigned long rank = 0, mismatch = 0;
+    skip_node_t *node;
+    skip_list_foreach(node, u32_skiplist){
+        unsigned long r = SKIP_LIST_GET_NODE_RANK(u32_skiplist, node);
+        mismatch += r != 0 && r != ++rank;
+    }
+    for(int i=0; i<n; i++){
+        SKIP_LIST_REMOVE_NODE(u32_skiplist, nodes[(i * 7919L) % n]);
+        mismatch += u32_skiplist->length != (unsigned long)(n - i - 1);
+    }
+    printf("%d nodes: get_node_rank and remove_node mismatch %lu, length %lu\n", n, mismatch, u32_skiplist->length);
+    free(nodes);
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_update_key(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //排行榜: n个玩家的分数随机变化, 检查update_key之后节点不变, key正确, list仍然有序.
+    //和remove_node+insert_multi的时间对比用./bench --case=update_key测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    skip_node_t **players = malloc(n * sizeof(*players));
+    uint32_t *scores = malloc(n * sizeof(*scores));
+    for(int i=0; i<n; i++){
+        scores[i] = (uint32_t)(rand() % 1000);
+        players[i] = SKIP_LIST_INSERT_MULTI(u32_skiplist, scores[i], (uint32_t)i);
+    }
+    unsigned long mismatch = 0;
+    for(int i=0; i<10*n; i++){
+        int p = rand() % n;
+        scores[p] += rand() % 100;
+        mismatch += SKIP_LIST_UPDATE_KEY(u32_skiplist, players[p], scores[p]) != players[p];
     }
+    for(int i=0; i<n; i++){
+        mismatch += players[i]->key.u32 != scores[i] || players[i]->value.u32 != (uint32_t)i;
+    }
+    uint32_t last = 0;
+    skip_node_t *node;
+    skip_list_foreach(node, u32_skiplist){
+        mismatch += node->key.u32 < last;
+        last = node->key.u32;
+    }
+    printf("%d players, %d update_key: mismatch %lu, length %lu\n", n, 10*n, mismatch, u32_skiplist->length);
+    free(scores);
+    free(players);
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_quantiles(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
 
-    clock_t t1 = clock();
+    //延迟的百分位: 一次合并查找的结果应该和每个百分位单独按排名查找一样. 时间用./bench --case=quantiles测量
     skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t);
-    for(int i=0; i<10*M; i++){
-        SKIP_LIST_INSERT(u32_skiplist, data[i], 0U);
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT_MULTI(u32_skiplist, (uint32_t)(rand() % 1000000), (uint32_t)i);
+    }
+    double qs[] = {0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 0.9999};
+    int nq = sizeof(qs) / sizeof(qs[0]);
+    skip_node_t *out[sizeof(qs) / sizeof(qs[0])];
+    skip_list_quantiles(u32_skiplist, qs, nq, out);
+    int mismatch = 0;
+    for(int j=0; j<nq; j++){
+        unsigned long rank = (unsigned long)(qs[j] * n);
+        rank += rank < qs[j] * n;
+        mismatch += out[j] != SKIP_LIST_GET_NODE_BY_RANK(u32_skiplist, rank);
+        printf("p%g = %u ", qs[j] * 100, out[j] != NULL ? out[j]->key.u32 : 0);
+    }
+    printf("\nquantiles and get_node_by_rank mismatch %d\n", mismatch);
+
+    skip_node_t *top[3];
+    unsigned long k = skip_list_select(u32_skiplist, 3, true, top);
+    for(unsigned long i=0; i<k; i++){
+        printf("top %lu: %u ", i+1, top[i]->key.u32);
+    }
+    printf("%s\n", k == 3 && top[0] == u32_skiplist->header->backward ? "" : "select error");
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_aggregate(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //计费: key是时间, value是金额. 区间的聚合值和沿着第0层累加的结果比较.
+    //用和不用-DSKIPLIST_AGGREGATE编译时的时间用./bench --case=aggregate测量
+    skip_list_t *i64_skiplist = SKIP_LIST_CREATE(int64_t, int64_t, SKIP_LIST_ARENA);
+    for(int64_t i=0; i<n; i++){
+        SKIP_LIST_APPEND(i64_skiplist, i, (int64_t)(rand() % 1000));
+    }
+    skip_agg_t agg;
+    int mismatch = 0;
+    for(int t=0; t<100; t++){
+        if(t == 50){
+            SKIP_LIST_UPDATE_VALUE(i64_skiplist, SKIP_LIST_FIND(i64_skiplist, (int64_t)(rand() % n)), (int64_t)-1);
+        }
+        int64_t lo = rand() % n, hi = lo + rand() % (n/10);
+        SKIP_LIST_AGGREGATE_RANGE(i64_skiplist, lo, hi, &agg);
+        unsigned long count = 0;
+        int64_t sum = 0, min = INT64_MAX, max = INT64_MIN;
+        skip_node_t *node;
+        skip_list_foreach(node, i64_skiplist){
+            if(node->key.i64 >= lo && node->key.i64 < hi){
+                count++;
+                sum += node->value.i64;
+                min = node->value.i64 < min ? node->value.i64 : min;
+                max = node->value.i64 > max ? node->value.i64 : max;
+            }
+        }
+        mismatch += agg.count != count || agg.sum.i64 != sum || (count > 0 && (agg.min.i64 != min || agg.max.i64 != max));
+    }
+    printf("%d nodes, 100 range aggregates, mismatch %d\n", n, mismatch);
+    SKIP_LIST_UPDATE_VALUE(i64_skiplist, SKIP_LIST_FIND(i64_skiplist, (int64_t)5), (int64_t)-1);
+    SKIP_LIST_AGGREGATE_RANGE(i64_skiplist, (int64_t)0, (int64_t)10, &agg);
+    printf("[0, 10): count %lu, sum %ld, min %ld, max %ld\n", agg.count, agg.sum.i64, agg.min.i64, agg.max.i64);
+    skip_list_aggregate_prefix(i64_skiplist, 10, &agg);
+    printf("prefix 10: count %lu, sum %ld\n", agg.count, agg.sum.i64);
+    SKIP_LIST_DESTROY(i64_skiplist);
+}
+
+void test_pop(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //定时器队列: key是到期时间, 用remove_node(第一个节点), pop_min和每次弹出100个的pop_min_n取出所有节点, 检查顺序和个数.
+    //时间用./bench --case=pop测量
+    skip_list_t *u64_skiplist = SKIP_LIST_CREATE(uint64_t, uint32_t, SKIP_LIST_ARENA);
+    element_t *keys = malloc(100 * sizeof(*keys));
+    for(int t=0; t<3; t++){
+        for(int i=0; i<n; i++){
+            SKIP_LIST_INSERT_MULTI(u64_skiplist, (uint64_t)rand(), (uint32_t)i);
+        }
+        uint64_t last = 0;
+        bool sorted = true;
+        unsigned long count = 0;
+        if(t == 0){
+            while(u64_skiplist->length > 0){
+                skip_node_t *first = u64_skiplist->header->level[0].forward;
+                sorted &= first->key.u64 >= last;
+                last = first->key.u64;
+                SKIP_LIST_REMOVE_NODE(u64_skiplist, first);
+                count++;
+            }
+        }else if(t == 1){
+            element_t key;
+            while(skip_list_pop_min(u64_skiplist, &key, NULL)){
+                sorted &= key.u64 >= last;
+                last = key.u64;
+                count++;
+            }
+        }else{
+            unsigned long k;
+            while((k = skip_list_pop_min_n(u64_skiplist, 100, keys, NULL)) > 0){
+                for(unsigned long i=0; i<k; i++){
+                    sorted &= keys[i].u64 >= last;
+                    last = keys[i].u64;
+                }
+                count += k;
+            }
+        }
+        printf("%d timers, %s: %lu popped, %s\n", n, t == 0 ? "remove_node" : (t == 1 ? "pop_min" : "pop_min_n(100)"),
+                count, sorted ? "in order" : "NOT in order");
     }
-    clock_t t2 = clock();
+    free(keys);
+    SKIP_LIST_DESTROY(u64_skiplist);
+}
 
-    printf("time : %f s\n", ((double)(t2-t1))/CLOCKS_PER_SEC);
+void test_find_batch(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //join: 互不相关的key(有重复), 批量查找的结果应该和逐个查找一样. 时间用./bench --case=find_batch测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT(u32_skiplist, (uint32_t)(rand() % (2*n)), (uint32_t)i);
+    }
+    uint32_t *keys = malloc(n * sizeof(*keys));
+    skip_node_t **nodes = malloc(n * sizeof(*nodes));
+    unsigned long *ranks = malloc(n * sizeof(*ranks));
+    for(int i=0; i<n; i++){
+        keys[i] = i % 3 ? (uint32_t)(rand() % (2*n)) : u32_skiplist->header->level[0].forward->key.u32;
+    }
+    SKIP_LIST_FIND_BATCH(u32_skiplist, keys, n, nodes);
+    SKIP_LIST_GET_RANK_BATCH(u32_skiplist, keys, n, ranks);
+    int found = 0, mismatch = 0;
+    for(int i=0; i<n; i++){
+        found += nodes[i] != NULL;
+        mismatch += nodes[i] != SKIP_LIST_FIND(u32_skiplist, keys[i]) || ranks[i] != SKIP_LIST_GET_RANK(u32_skiplist, keys[i]);
+    }
+    printf("%d nodes, %d keys: found %d, find_batch and get_rank_batch mismatch %d\n", n, n, found, mismatch);
+    free(keys);
+    free(nodes);
+    free(ranks);
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_seek_sorted(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //merge join: 用另一个索引的有序key探测list, 结果应该和逐个查找一样. 时间用./bench --case=seek_sorted测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    uint32_t *keys = malloc(n * sizeof(*keys));
+    skip_node_t **nodes = malloc(n * sizeof(*nodes));
+    unsigned long *ranks = malloc(n * sizeof(*ranks));
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT(u32_skiplist, (uint32_t)i*2, (uint32_t)i);
+        keys[i] = (uint32_t)i*3;
+    }
+    unsigned long found = SKIP_LIST_SEEK_SORTED(u32_skiplist, keys, n, nodes, ranks);
+    int mismatch = 0;
+    for(int i=0; i<n; i++){
+        mismatch += nodes[i] != SKIP_LIST_FIND(u32_skiplist, keys[i]) || ranks[i] != SKIP_LIST_GET_RANK(u32_skiplist, keys[i]);
+    }
+    printf("%d nodes, %d sorted probes, seek_sorted found %lu, mismatch %d\n", n, n, found, mismatch);
+    uint32_t some[] = {3, 6, 12};
+    SKIP_LIST_INTERSECT_SORTED_KEYS(u32_skiplist, some, 3, nodes, ranks);
+    printf("intersect {3, 6, 12}: %u (rank %lu), %u (rank %lu)\n", nodes[0]->key.u32, ranks[0], nodes[1]->key.u32, ranks[1]);
+    free(keys);
+    free(nodes);
+    free(ranks);
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+void test_zset(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    zset_t *z = zset_create();
+    zset_add(z, "alice", 30.5);
+    zset_add(z, "bob", 12);
+    zset_add(z, "carol", 47.25);
+    zset_add(z, "dave", 12);
+    zset_incrby(z, "bob", 20);
+    zset_remove(z, "dave");
+    double score = 0;
+    bool found = zset_score(z, "bob", &score);
+    printf("length %lu, bob score %s %f, rank %lu, count [30, 50) == %lu\n", zset_length(z),
+            found ? "found" : "not found", score, zset_rank(z, "bob"), zset_count(z, 30, 50));
+    skip_node_t *node;
+    zset_foreach_range(node, z, 0, 100){
+        printf("%s(%.2f)-", ZSET_MEMBER(node), ZSET_SCORE(node));
+    }
+    printf("\n");
+
+    //1M次随机加分, 每次只查一次哈希表, 节点原地移动
+    char member[32];
+    for(int i=0; i<100*K; i++){
+        sprintf(member, "player:%d", i);
+        zset_add(z, member, rand() % 1000);
+    }
+    clock_t begin = clock();
+    for(int i=0; i<M; i++){
+        sprintf(member, "player:%d", rand() % (100*K));
+        zset_incrby(z, member, rand() % 10);
+    }
+    printf("%lu members, 1M incrby: %f, top: %s\n", zset_length(z), (double)(clock()-begin)/CLOCKS_PER_SEC,
+            ZSET_MEMBER(zset_get_by_rank(z, zset_length(z))));
+    zset_destroy(z);
+}
+
+void test_skiplist32(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //同样的u32->u32插入和查找(key互不相同, 顺序打乱), 检查普通skiplist和32位下标的skiplist的结果一致, 比较节点内存.
+    //时间用./bench --case=skiplist32测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t, SKIP_LIST_ARENA);
+    skip_list32_t *u32_skiplist32 = SKIP_LIST32_CREATE(uint32_t, uint32_t);
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT(u32_skiplist, (uint32_t)i * 2654435761u, (uint32_t)i);
+        SKIP_LIST32_INSERT(u32_skiplist32, (uint32_t)i * 2654435761u, (uint32_t)i);
+    }
+    unsigned long mismatch = 0;
+    for(int i=0; i<n; i++){
+        uint32_t key = (uint32_t)(i * 7919L % n) * 2654435761u;
+        skip_node_t *node = SKIP_LIST_FIND(u32_skiplist, key);
+        uint32_t node32 = SKIP_LIST32_FIND(u32_skiplist32, key);
+        mismatch += node == NULL || node32 == 0 || node->value.u32 != SKIP_LIST32_NODE(u32_skiplist32, node32)->value;
+        //SKIPLIST_NO_RANK时get_rank总是返回0
+        unsigned long rank = SKIP_LIST_GET_RANK(u32_skiplist, key);
+        mismatch += rank != 0 && rank != SKIP_LIST32_GET_RANK(u32_skiplist32, key);
+    }
+    skip_list_stats_t stats;
+    skip_list_stats(u32_skiplist, &stats);
+    unsigned long bytes = 0;
+    for(int h=1; h<=SKIPLIST_MAXLEVEL; h++){
+        bytes += stats.level_histogram[h] * (sizeof(skip_node_t) + h*sizeof(struct skiplist_level));
+    }
+    printf("%d nodes, mismatch %lu, skiplist %.1f bytes/node, skiplist32 %.1f bytes/node\n", n, mismatch,
+            (double)bytes/u32_skiplist->length, (double)u32_skiplist32->used * sizeof(uint32_t) / u32_skiplist32->length);
     SKIP_LIST_DESTROY(u32_skiplist);
-    free(data);
+    SKIP_LIST32_DESTROY(u32_skiplist32);
+}
+
+void test_lf_skiplist(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    lf_list = LF_SKIP_LIST_CREATE(uint32_t, uint32_t);
+    pthread_t tids[LF_THREADS];
+    for(int i=0; i<LF_THREADS; i++){
+        pthread_create(&tids[i], NULL, lf_worker, (void *)(uintptr_t)i);
+    }
+    unsigned long count = 0;
+    for(int i=0; i<LF_THREADS; i++){
+        void *ret;
+        pthread_join(tids[i], &ret);
+        count += (uintptr_t)ret;
+    }
+
+    unsigned long n = 0;
+    uint32_t prev = 0;
+    lf_skip_node_t *node = (lf_skip_node_t *)lf_list->header->forward[0];
+    for(; node != NULL; node = (lf_skip_node_t *)node->forward[0], n++){
+        if(n > 0 && node->key.u32 <= prev) printf("lf_skiplist: order error\n");
+        prev = node->key.u32;
+    }
+    printf("lf_skiplist: %d threads, %lu keys, length %lu, walk %lu\n", LF_THREADS, count, atomic_load(&lf_list->length), n);
+
+    LF_SKIP_LIST_DESTROY(lf_list);
+    lf_skip_list_reclaim();
+}
+
+void test_sharded(){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    sharded_list = SHARDED_SKIP_LIST_CREATE(uint32_t, uint32_t, 64);
+    pthread_t tids[SHARDED_THREADS];
+    clock_t begin = clock();
+    for(int i=0; i<SHARDED_THREADS; i++){
+        pthread_create(&tids[i], NULL, sharded_worker, (void *)(uintptr_t)i);
+    }
+    unsigned long count = 0;
+    for(int i=0; i<SHARDED_THREADS; i++){
+        void *ret;
+        pthread_join(tids[i], &ret);
+        count += (uintptr_t)ret;
+    }
+    double seconds = (double)(clock()-begin)/CLOCKS_PER_SEC;
+
+    //按全局排名遍历, key必须递增, 并且get_rank和排名一致
+    unsigned long length = sharded_skip_list_length(sharded_list);
+    element_t key, prev = {.u32 = 0};
+    for(unsigned long rank=1; sharded_skip_list_get_by_rank(sharded_list, rank, &key, NULL); rank++){
+        if(rank > 1 && key.u32 <= prev.u32) printf("sharded_skiplist: order error at rank %lu\n", rank);
+        if(rank % 1000 == 0 && SHARDED_SKIP_LIST_GET_RANK(sharded_list, key.u32) != rank) printf("sharded_skiplist: rank %lu error\n", rank);
+        prev = key;
+    }
+    printf("sharded_skiplist: %d threads, %lu keys, length %lu, %d shards, cpu %f\n", SHARDED_THREADS, count, length, atomic_load(&sharded_list->nshards), seconds);
+
+    SHARDED_SKIP_LIST_DESTROY(sharded_list);
 }
 
 void test_type_err(){
     fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
 
-    skip_list_t *double_skiplist = SKIP_LIST_CREATE(double, int32_t);
-    SKIP_LIST_DESTROY(double_skiplist);
+    skip_list_t *ptr_skiplist = SKIP_LIST_CREATE(void *, int32_t);
+    SKIP_LIST_DESTROY(ptr_skiplist);
 }
 
 void test_srt(){
@@ -135,14 +809,137 @@ void test_srt(){
     SKIP_LIST_DESTROY(str_skiplist);
 }
 
+void test_set_ops(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //两个有序list的集合运算, 检查长度和顺序, 并集和逐个插入得到的list逐个节点比较.
+    //和逐个插入的时间对比用./bench --case=set_ops测量
+    skip_list_t *a = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    skip_list_t *b = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT(a, (uint32_t)i*2, (uint32_t)i);
+        SKIP_LIST_INSERT(b, (uint32_t)i*3, (uint32_t)i);
+    }
+    skip_list_t *c = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    skip_node_t *node;
+    skip_list_foreach(node, a){
+        SKIP_LIST_INSERT(c, node->key.u32, node->value.u32);
+    }
+    skip_list_foreach(node, b){
+        SKIP_LIST_INSERT(c, node->key.u32, node->value.u32);
+    }
+    skip_list_t *u = skip_list_union(a, b, false);
+    int mismatch = u->length != c->length;
+    for(skip_node_t *x=u->header->level[0].forward, *y=c->header->level[0].forward; x!=u->header && y!=c->header;
+            x=x->level[0].forward, y=y->level[0].forward){
+        mismatch += x->key.u32 != y->key.u32;
+    }
+    skip_list_t *x = skip_list_intersect(a, b, false);
+    skip_list_t *d = skip_list_difference(a, b, false);
+    skip_list_t *m = skip_list_merge(a, b);
+    //a和b的公共key是6的倍数
+    unsigned long common = (unsigned long)(2*(n-1) / 6 + 1);
+    mismatch += x->length != common || d->length != (unsigned long)n - common || m->length != 2*(unsigned long)n;
+    mismatch += u->length != 2*(unsigned long)n - common;
+    printf("%d and %d nodes: union %lu, intersect %lu, difference %lu, merge %lu, mismatch %d\n", n, n,
+            u->length, x->length, d->length, m->length, mismatch);
+    SKIP_LIST_DESTROY(c);
+    SKIP_LIST_DESTROY(u);
+    SKIP_LIST_DESTROY(x);
+    SKIP_LIST_DESTROY(d);
+    SKIP_LIST_DESTROY(m);
+    SKIP_LIST_DESTROY(a);
+    SKIP_LIST_DESTROY(b);
+}
+
+
+void test_split_concat(int n){
+    fprintf(stderr, "\n=============== [ %s ] ================\n", __func__);
+
+    //把list的后一半移到另一个list再接回来(例如迁移分片), 检查长度, 切开的位置和接回之后的顺序和排名.
+    //和逐个删除插入的时间对比用./bench --case=split_concat测量
+    skip_list_t *u32_skiplist = SKIP_LIST_CREATE(uint32_t, uint32_t);
+    for(int i=0; i<n; i++){
+        SKIP_LIST_INSERT(u32_skiplist, (uint32_t)i, (uint32_t)i);
+    }
+    skip_list_t *other = SKIP_LIST_SPLIT_AT_KEY(u32_skiplist, (uint32_t)n/2);
+    unsigned long left = u32_skiplist->length, right = other->length;
+    int mismatch = left + right != (unsigned long)n || left != (unsigned long)n/2;
+    mismatch += u32_skiplist->header->backward->key.u32 != (uint32_t)n/2 - 1 || other->header->level[0].forward->key.u32 != (uint32_t)n/2;
+    bool ok = SKIP_LIST_CONCAT(u32_skiplist, other);
+    mismatch += !ok || u32_skiplist->length != (unsigned long)n || other->length != 0;
+    uint32_t i = 0;
+    skip_node_t *node;
+    skip_list_foreach(node, u32_skiplist){
+        //SKIPLIST_NO_RANK时get_node_rank总是返回0
+        unsigned long rank = SKIP_LIST_GET_NODE_RANK(u32_skiplist, node);
+        mismatch += node->key.u32 != i || (rank != 0 && rank != i + 1);
+        i++;
+    }
+    printf("%d nodes, split at key %d: %lu + %lu, concat %d, mismatch %d\n", n, n/2, left, right, ok, mismatch);
+    //SKIPLIST_NO_RANK时split_at_rank返回NULL
+    skip_list_t *tail = SKIP_LIST_SPLIT_AT_RANK(u32_skiplist, 10);
+    if(tail != NULL){
+        printf("split at rank 10: %lu + %lu, first key of the rest %u\n", u32_skiplist->length, tail->length, tail->header->level[0].forward->key.u32);
+        SKIP_LIST_DESTROY(tail);
+    }
+    SKIP_LIST_DESTROY(other);
+    SKIP_LIST_DESTROY(u32_skiplist);
+}
+
+
 int main(){
 
     test_int32();
 
-    test_uint32_bench();
-    
+    test_arena();
+
     test_srt();
 
+    test_build_sorted();
+
+    test_insert_batch();
+
+    test_hint();
+
+    test_append();
+
+    test_range();
+
+    test_key_prefix();
+
+    test_stats();
+
+    test_no_rank();
+
+    test_prefetch(100*K);
+
+    test_node_handle(1*K);
+
+    test_update_key(1*K);
+
+    test_quantiles(10*K);
+
+    test_aggregate(10*K);
+
+    test_pop(10*K);
+
+    test_find_batch(10*K);
+
+    test_seek_sorted(10*K);
+
+    test_set_ops(10*K);
+
+    test_split_concat(10*K);
+
+    test_zset();
+
+    test_skiplist32(10*K);
+
+    test_sharded();
+
+    test_lf_skiplist();
+
     test_type_err();
 
     return 0;
@@ -0,0 +1,176 @@
+/*
+有序集合: skiplist + member哈希表
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zset.h"
+
+
+#define ZSET_INIT_SLOTS 16
+
+
+//FNV-1a
+static uint64_t zset_hash(const char *member){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(const unsigned char *p=(const unsigned char *)member; *p; p++){
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+zset_t *zset_create(void){
+    zset_t *z = malloc(sizeof(*z));
+    z->list = skip_list_create(TDOUBLE, TSTR, compare_func_list[TDOUBLE], SKIP_LIST_ARENA);
+    z->slots = calloc(ZSET_INIT_SLOTS, sizeof(zset_slot_t));
+    z->mask = ZSET_INIT_SLOTS - 1;
+    return z;
+}
+
+
+void zset_destroy(zset_t *z){
+    skip_node_t *node;
+    skip_list_foreach(node, z->list){
+        free(node->value.s);
+    }
+    skip_list_destroy(z->list);
+    free(z->slots);
+    free(z);
+}
+
+
+unsigned long zset_length(zset_t *z){
+    return z->list->length;
+}
+
+
+//member所在的槽, 不存在时返回探测结束的空槽
+static zset_slot_t *zset_lookup(zset_t *z, const char *member, uint64_t hash){
+    for(unsigned long i=hash & z->mask; ; i=(i+1) & z->mask){
+        zset_slot_t *slot = &z->slots[i];
+        if(slot->node == NULL || (slot->hash == hash && strcmp(slot->node->value.s, member) == 0)){
+            return slot;
+        }
+    }
+}
+
+
+//装载因子超过3/4时槽数翻倍
+static void zset_grow(zset_t *z){
+    unsigned long n = z->mask + 1;
+    if((z->list->length + 1) * 4 < n * 3){
+        return;
+    }
+    zset_slot_t *old = z->slots;
+    z->slots = calloc(2*n, sizeof(zset_slot_t));
+    z->mask = 2*n - 1;
+    for(unsigned long i=0; i<n; i++){
+        if(old[i].node != NULL){
+            unsigned long j = old[i].hash & z->mask;
+            while(z->slots[j].node != NULL){
+                j = (j+1) & z->mask;
+            }
+            z->slots[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+
+//删除槽之后把后面同一段探测序列中的元素向前移动, 不需要墓碑
+static void zset_slot_delete(zset_t *z, zset_slot_t *slot){
+    unsigned long i = slot - z->slots;
+    for(unsigned long j=(i+1) & z->mask; z->slots[j].node != NULL; j=(j+1) & z->mask){
+        unsigned long home = z->slots[j].hash & z->mask;
+        //home不在(i, j]之间时, j上的元素可以移动到i
+        if((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)){
+            z->slots[i] = z->slots[j];
+            i = j;
+        }
+    }
+    z->slots[i].node = NULL;
+}
+
+
+bool zset_add(zset_t *z, const char *member, double score){
+    uint64_t hash = zset_hash(member);
+    zset_slot_t *slot = zset_lookup(z, member, hash);
+    if(slot->node != NULL){
+        skip_list_update_key(z->list, slot->node, (element_t)score);
+        return false;
+    }
+    zset_grow(z);
+    slot = zset_lookup(z, member, hash);
+    slot->hash = hash;
+    slot->node = skip_list_insert_multi(z->list, (element_t)score, (element_t)strdup(member));
+    return true;
+}
+
+
+double zset_incrby(zset_t *z, const char *member, double delta){
+    skip_node_t *node = zset_find(z, member);
+    if(node == NULL){
+        zset_add(z, member, delta);
+        return delta;
+    }
+    skip_list_update_key(z->list, node, (element_t)(ZSET_SCORE(node) + delta));
+    return ZSET_SCORE(node);
+}
+
+
+bool zset_remove(zset_t *z, const char *member){
+    zset_slot_t *slot = zset_lookup(z, member, zset_hash(member));
+    skip_node_t *node = slot->node;
+    if(node == NULL){
+        return false;
+    }
+    zset_slot_delete(z, slot);
+    free(node->value.s);
+    skip_list_remove_node(z->list, node);
+    return true;
+}
+
+
+skip_node_t *zset_find(zset_t *z, const char *member){
+    return zset_lookup(z, member, zset_hash(member))->node;
+}
+
+
+bool zset_score(zset_t *z, const char *member, double *score){
+    skip_node_t *node = zset_find(z, member);
+    if(node == NULL){
+        return false;
+    }
+    *score = ZSET_SCORE(node);
+    return true;
+}
+
+
+unsigned long zset_rank(zset_t *z, const char *member){
+    skip_node_t *node = zset_find(z, member);
+    return node != NULL ? skip_list_get_node_rank(z->list, node) : 0;
+}
+
+
+skip_node_t *zset_get_by_rank(zset_t *z, unsigned long rank){
+    return skip_list_get_node_by_rank(z->list, rank);
+}
+
+
+unsigned long zset_count(zset_t *z, double lo, double hi){
+    return skip_list_count_range(z->list, (element_t)lo, (element_t)hi);
+}
+
+
+unsigned long zset_remove_range(zset_t *z, double lo, double hi){
+    //先从哈希表中删除并释放member, 节点由skip_list_remove_range一次删除
+    skip_node_t *node;
+    zset_foreach_range(node, z, lo, hi){
+        zset_slot_delete(z, zset_lookup(z, node->value.s, zset_hash(node->value.s)));
+        free(node->value.s);
+    }
+    return skip_list_remove_range(z->list, (element_t)lo, (element_t)hi);
+}
@@ -0,0 +1,84 @@
+#ifndef ZSET_H
+#define ZSET_H
+
+#include "skiplist.h"
+
+/*
+类似redis的有序集合: 一个按分数排序的skiplist(key是double分数, value是member字符串),
+加上一个从member到skiplist节点的哈希表.
+按member查找分数是O(1), 修改分数用skip_list_update_key直接移动节点, 排名和按分数的范围查询都在skiplist上完成.
+member在添加时复制一份, 由zset负责释放. 分数相同的member按节点地址排序(redis按member的字典序).
+分数不能是NaN.
+*/
+
+typedef struct zset zset_t;
+typedef struct zset_slot zset_slot_t;
+
+
+struct zset_slot {
+    uint64_t hash;
+    skip_node_t *node; //NULL表示空槽
+};
+
+
+struct zset {
+    skip_list_t *list;
+    zset_slot_t *slots; //开放寻址, 线性探测
+    unsigned long mask; //槽数减1, 槽数是2的幂
+};
+
+
+//节点的分数和member
+#define ZSET_SCORE(node) ((node)->key.f)
+#define ZSET_MEMBER(node) ((const char *)(node)->value.s)
+
+
+//遍历分数在[lo, hi)之间的节点, 按分数从小到大
+#define zset_foreach_range(node, z, lo, hi) skip_list_foreach_range(node, (z)->list, (element_t)(double)(lo), (element_t)(double)(hi))
+
+
+zset_t *zset_create(void);
+
+
+void zset_destroy(zset_t *z);
+
+
+unsigned long zset_length(zset_t *z);
+
+
+//member不存在时添加, 返回true; 已经存在时修改分数, 返回false
+bool zset_add(zset_t *z, const char *member, double score);
+
+
+//给member的分数加上delta, member不存在时以delta为分数添加. 返回新的分数
+double zset_incrby(zset_t *z, const char *member, double delta);
+
+
+bool zset_remove(zset_t *z, const char *member);
+
+
+//member对应的节点, 不存在时返回NULL
+skip_node_t *zset_find(zset_t *z, const char *member);
+
+
+//member存在时把分数写到score中, 返回true
+bool zset_score(zset_t *z, const char *member, double *score);
+
+
+//member按分数从小到大的排名, 从1开始, 不存在时返回0
+unsigned long zset_rank(zset_t *z, const char *member);
+
+
+//排名为rank的节点, 从1开始, 超出范围时返回NULL
+skip_node_t *zset_get_by_rank(zset_t *z, unsigned long rank);
+
+
+//分数在[lo, hi)之间的member个数
+unsigned long zset_count(zset_t *z, double lo, double hi);
+
+
+//删除分数在[lo, hi)之间的所有member, 返回删除的个数
+unsigned long zset_remove_range(zset_t *z, double lo, double hi);
+
+
+#endif //ifndef ZSET_H
@@ -0,0 +1,102 @@
+/*
+比较按类型生成的skiplist2和动态类型的skip_list_t.
+用法: ./bench [key的个数]
+*/
+
+#define NDEBUG
+
+#include "skiplist.h"
+#include "skiplist2.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+DEF_SKIP_LIST(uint32_t, u32, uint32_t, u32, SKIP_COMPARE_NUM)
+DEF_SKIP_LIST(uint64_t, u64, uint32_t, u32, SKIP_COMPARE_NUM)
+DEF_SKIP_LIST(char *, s, uint32_t, u32, SKIP_COMPARE_STR)
+
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void report(const char *type, const char *impl, unsigned long n, double insert, double find, double remove){
+    printf("%s,%s,%lu,%.1f,%.1f,%.1f\n", type, impl, n, insert / n * 1e9, find / n * 1e9, remove / n * 1e9);
+}
+
+
+//两种实现都用同一段代码测量, 只有每个操作的写法不同. 重复ROUNDS次取最好的结果, 减少机器上其他负载的干扰.
+#define ROUNDS 5
+#define BENCH(TYPE, IMPL, N, KEYS, CREATE, INSERT, FIND, REMOVE, DESTROY) do{ \
+    double best[3] = {1e9, 1e9, 1e9}; \
+    for(int r=0; r<ROUNDS; r++){ \
+        srand(1); \
+        __auto_type l = CREATE; \
+        double t0 = now(); \
+        for(unsigned long i=0; i<(N); i++){ \
+            INSERT(l, (KEYS)[i], (uint32_t)i); \
+        } \
+        double t1 = now(); \
+        unsigned long found = 0; \
+        for(unsigned long i=0; i<(N); i++){ \
+            found += FIND(l, (KEYS)[(i * 7919) % (N)]) != NULL; \
+        } \
+        double t2 = now(); \
+        for(unsigned long i=0; i<(N); i++){ \
+            REMOVE(l, (KEYS)[i]); \
+        } \
+        double t3 = now(); \
+        if(found != (N)) printf("%s %s: found %lu != %lu\n", TYPE, IMPL, found, (unsigned long)(N)); \
+        DESTROY(l); \
+        best[0] = t1-t0 < best[0] ? t1-t0 : best[0]; \
+        best[1] = t2-t1 < best[1] ? t2-t1 : best[1]; \
+        best[2] = t3-t2 < best[2] ? t3-t2 : best[2]; \
+    } \
+    report(TYPE, IMPL, (N), best[0], best[1], best[2]); \
+}while(0)
+
+
+int main(int argc, char **argv){
+    unsigned long n = argc > 1? strtoul(argv[1], NULL, 10): 1000000;
+
+    //key互不相同, 顺序随机
+    uint32_t *u32_keys = malloc(n * sizeof(*u32_keys));
+    uint64_t *u64_keys = malloc(n * sizeof(*u64_keys));
+    char **str_keys = malloc(n * sizeof(*str_keys));
+    for(unsigned long i=0; i<n; i++){
+        u32_keys[i] = i * 2654435761u;
+        u64_keys[i] = (uint64_t)u32_keys[i] << 32 | i;
+        str_keys[i] = malloc(24);
+        sprintf(str_keys[i], "key:%08x", u32_keys[i]);
+    }
+
+    printf("type,impl,n,insert_ns,find_ns,remove_ns\n");
+
+    BENCH("u32", "skip_list_t", n, u32_keys, SKIP_LIST_CREATE(uint32_t, uint32_t),
+          SKIP_LIST_INSERT, SKIP_LIST_FIND, SKIP_LIST_REMOVE, SKIP_LIST_DESTROY);
+    BENCH("u32", "skiplist2", n, u32_keys, skip_list_create_u32_u32(),
+          skip_list_insert_u32_u32, skip_list_find_u32_u32, skip_list_remove_u32_u32, skip_list_destroy_u32_u32);
+
+    BENCH("u64", "skip_list_t", n, u64_keys, SKIP_LIST_CREATE(uint64_t, uint32_t),
+          SKIP_LIST_INSERT, SKIP_LIST_FIND, SKIP_LIST_REMOVE, SKIP_LIST_DESTROY);
+    BENCH("u64", "skiplist2", n, u64_keys, skip_list_create_u64_u32(),
+          skip_list_insert_u64_u32, skip_list_find_u64_u32, skip_list_remove_u64_u32, skip_list_destroy_u64_u32);
+
+    BENCH("str", "skip_list_t", n, str_keys, SKIP_LIST_CREATE(char *, uint32_t),
+          SKIP_LIST_INSERT, SKIP_LIST_FIND, SKIP_LIST_REMOVE, SKIP_LIST_DESTROY);
+    BENCH("str", "skiplist2", n, str_keys, skip_list_create_s_u32(),
+          skip_list_insert_s_u32, skip_list_find_s_u32, skip_list_remove_s_u32, skip_list_destroy_s_u32);
+
+    for(unsigned long i=0; i<n; i++){
+        free(str_keys[i]);
+    }
+    free(str_keys);
+    free(u64_keys);
+    free(u32_keys);
+    return 0;
+}
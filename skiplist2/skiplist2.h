@@ -0,0 +1,373 @@
+#ifndef SKIPLIST2_H
+#define SKIPLIST2_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+按类型生成的skiplist: DEF_SKIP_LIST(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE)
+生成一套保存真实KEY_TYPE/VALUE_TYPE的skiplist, 类型和函数名带有_KNAME_VNAME后缀,
+例如 DEF_SKIP_LIST(uint32_t, u32, uint32_t, u32, SKIP_COMPARE_NUM) 生成
+skip_list_u32_u32_t, skip_list_create_u32_u32(), skip_list_insert_u32_u32() ...
+COMPARE(a, b)是一个宏(或者inline函数), 返回值和strcmp一样. 比较在编译期展开,
+不像skiplist.c那样每一步都要通过compare_func_t函数指针调用.
+list中的函数指针只是为了可以写成 l->insert(l, key, value), 直接调用生成的函数效果一样.
+*/
+
+
+#ifndef SKIPLIST_MAXLEVEL
+#define SKIPLIST_MAXLEVEL 32 /* Should be enough for 2^64 elements */
+#endif
+
+#ifndef SKIPLIST_P
+#define SKIPLIST_P 0.25      /* Skiplist P = 1/4 */
+#endif
+
+
+#define SKIP_COMPARE_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+#define SKIP_COMPARE_STR(a, b) (strcmp((a), (b)))
+
+
+#define skip_list2_foreach(node, l) \
+        for ((node) = (l)->header->level[0].forward; (node)!=(l)->header; (node)=(node)->level[0].forward)
+
+
+#define skip_list2_foreach_safe(node, l) \
+        (node) = (l)->header->level[0].forward; \
+        for (__typeof__(node) tMp__=(node)->level[0].forward; (node)!=(l)->header; (node)=tMp__, tMp__=(node)->level[0].forward)
+
+
+#define skip_list2_foreach_reverse(node, l) \
+        for ((node) = (l)->header->backward; node!=(l)->header; (node)=(node)->backward)
+
+
+#define skip_list2_foreach_reverse_safe(node, l) \
+        (node) = (l)->header->backward; \
+        for (__typeof__(node) tMp__=(node)->backward; (node)!=(l)->header; (node)=tMp__, tMp__=(node)->backward)
+
+
+static inline int skip_list2_random_level(void) {
+    static const int threshold = SKIPLIST_P*RAND_MAX;
+    int level = 1;
+    while (rand() < threshold)
+        level += 1;
+    return (level<SKIPLIST_MAXLEVEL) ? level : SKIPLIST_MAXLEVEL;
+}
+
+
+#define DEF_SKIP_NODE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+typedef struct skip_node_##KNAME##_##VNAME skip_node_##KNAME##_##VNAME##_t; \
+struct skip_node_##KNAME##_##VNAME { \
+    KEY_TYPE key; \
+    VALUE_TYPE value; \
+    skip_node_##KNAME##_##VNAME##_t *backward; \
+    struct skip_level_##KNAME##_##VNAME { \
+        skip_node_##KNAME##_##VNAME##_t *forward; \
+        unsigned long span;  \
+    }level[]; \
+};
+
+
+#define DEF_SKIP_LIST_TYPE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+DEF_SKIP_NODE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+typedef struct skip_list_##KNAME##_##VNAME skip_list_##KNAME##_##VNAME##_t; \
+typedef skip_node_##KNAME##_##VNAME##_t* (*insert_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key, VALUE_TYPE value); \
+typedef skip_node_##KNAME##_##VNAME##_t* (*find_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key); \
+typedef bool (*remove_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key); \
+typedef bool (*remove_node_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, skip_node_##KNAME##_##VNAME##_t *node); \
+typedef unsigned long (*get_rank_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key); \
+typedef unsigned long (*get_node_rank_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, skip_node_##KNAME##_##VNAME##_t *node); \
+typedef skip_node_##KNAME##_##VNAME##_t* (*get_node_by_rank_func_##KNAME##_##VNAME##_t)(skip_list_##KNAME##_##VNAME##_t *l, unsigned long rank); \
+struct skip_list_##KNAME##_##VNAME { \
+    unsigned long length; \
+    int level; \
+    skip_node_##KNAME##_##VNAME##_t *header; \
+    insert_func_##KNAME##_##VNAME##_t insert; \
+    insert_func_##KNAME##_##VNAME##_t insert_multi; \
+    find_func_##KNAME##_##VNAME##_t find; \
+    remove_func_##KNAME##_##VNAME##_t remove; \
+    remove_node_func_##KNAME##_##VNAME##_t remove_node; \
+    get_rank_func_##KNAME##_##VNAME##_t get_rank; \
+    get_node_rank_func_##KNAME##_##VNAME##_t get_node_rank; \
+    get_node_by_rank_func_##KNAME##_##VNAME##_t get_node_by_rank; \
+};
+
+
+#define DEF_SKIP_NODE_CREATE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+static inline skip_node_##KNAME##_##VNAME##_t *skip_node_create_##KNAME##_##VNAME(int level, KEY_TYPE key, VALUE_TYPE value){ \
+    skip_node_##KNAME##_##VNAME##_t *node = malloc(sizeof(*node) + level*sizeof(node->level[0])); \
+    node->key = key; \
+    node->value = value; \
+    return node; \
+}
+
+
+//link: 把node链接到update[]之后, update[i]是第i层的前驱, rank[i]是它的排名. 层数增加时会补齐新层的update和rank.
+//unlink: 把node从list中摘下来但不释放, update[i]是node在第i层的前驱.
+#define DEF_SKIP_LIST_LINK(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+static inline void skip_list_link_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, skip_node_##KNAME##_##VNAME##_t *node, int level, \
+                                                   skip_node_##KNAME##_##VNAME##_t **update, unsigned long *rank){ \
+    if(level > l->level){ \
+        for(int i=l->level; i<level; i++){ \
+            rank[i] = 0; \
+            update[i] = l->header; \
+            update[i]->level[i].span = l->length; \
+        } \
+        l->level = level; \
+    } \
+    for(int i=0; i<level ; i++){ \
+        node->level[i].forward = update[i]->level[i].forward; \
+        skip_node_##KNAME##_##VNAME##_t *prev = update[i]; \
+        prev->level[i].forward = node; \
+        node->level[i].span = prev->level[i].span - (rank[0] - rank[i]); \
+        prev->level[i].span = (rank[0] - rank[i])+1; \
+    } \
+    node->backward = update[0]; \
+    node->level[0].forward->backward = node; \
+    for(int i=level; i < l->level; i++){ \
+        update[i]->level[i].span++; \
+    } \
+    l->length++; \
+} \
+\
+static inline void skip_list_unlink_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, skip_node_##KNAME##_##VNAME##_t *node, \
+                                                     skip_node_##KNAME##_##VNAME##_t **update){ \
+    for(int i=l->level-1; i>=0 ; i--){ \
+        skip_node_##KNAME##_##VNAME##_t *prev = update[i]; \
+        if(prev->level[i].forward == node){ \
+            prev->level[i].span  += node->level[i].span - 1; \
+            prev->level[i].forward = node->level[i].forward; \
+        }else{ \
+            prev->level[i].span--; \
+        } \
+    } \
+    node->level[0].forward->backward = update[0]; \
+    l->length--; \
+    while(l->level>1 && l->header->level[l->level-1].forward == l->header){ \
+        l->level--; \
+    } \
+}
+
+
+#define DEF_SKIP_LIST_INSERT(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+static inline skip_node_##KNAME##_##VNAME##_t *skip_list_insert_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key, VALUE_TYPE value){ \
+    skip_node_##KNAME##_##VNAME##_t *update[SKIPLIST_MAXLEVEL] = {}; \
+    unsigned long rank[SKIPLIST_MAXLEVEL] = {}; \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for(int i=l->level-1; i>=0; i--){ \
+        rank[i] = i == (l->level-1) ? 0 : rank[i+1]; \
+        while(cur->level[i].forward != l->header){ \
+            int comp = COMPARE(cur->level[i].forward->key, key); \
+            if(comp < 0){ \
+                rank[i] += cur->level[i].span;\
+                cur = cur->level[i].forward; \
+            }else if(comp == 0){\
+                return NULL; \
+            }else { \
+                break; \
+            } \
+        } \
+        update[i] = cur; \
+    } \
+    int insert_level = skip_list2_random_level();\
+    skip_node_##KNAME##_##VNAME##_t *node = skip_node_create_##KNAME##_##VNAME(insert_level, key, value); \
+    skip_list_link_##KNAME##_##VNAME(l, node, insert_level, update, rank); \
+    return node; \
+}
+
+
+#define DEF_SKIP_LIST_INSERT_MULTI(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+static inline skip_node_##KNAME##_##VNAME##_t *skip_list_insert_multi_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key, VALUE_TYPE value){ \
+    skip_node_##KNAME##_##VNAME##_t *update[SKIPLIST_MAXLEVEL] = {}; \
+    unsigned long rank[SKIPLIST_MAXLEVEL] = {}; \
+    int insert_level = skip_list2_random_level();\
+    skip_node_##KNAME##_##VNAME##_t *node = skip_node_create_##KNAME##_##VNAME(insert_level, key, value); \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for(int i=l->level-1; i>=0; i--){ \
+        rank[i] = i == (l->level-1) ? 0 : rank[i+1]; \
+        while(cur->level[i].forward != l->header){ \
+            int comp = COMPARE(cur->level[i].forward->key, key); \
+            if(comp < 0 || (comp == 0 && cur->level[i].forward < node)){ \
+                rank[i] += cur->level[i].span;\
+                cur = cur->level[i].forward; \
+            }else { \
+                break; \
+            } \
+        } \
+        update[i] = cur; \
+    } \
+    skip_list_link_##KNAME##_##VNAME(l, node, insert_level, update, rank); \
+    return node; \
+}
+
+
+#define DEF_SKIP_LIST_FIND(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+static inline skip_node_##KNAME##_##VNAME##_t *skip_list_find_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key){ \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for (int i = l->level-1; i >= 0; i--) { \
+        while(cur->level[i].forward != l->header && COMPARE(cur->level[i].forward->key, key) < 0){ \
+            cur = cur->level[i].forward; \
+        } \
+    } \
+    cur = cur->level[0].forward; \
+    if(cur != l->header && COMPARE(cur->key, key) == 0){ \
+        return cur; \
+    }else{ \
+        return NULL; \
+    } \
+}
+
+
+#define DEF_SKIP_LIST_REMOVE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+static inline bool skip_list_remove_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key){ \
+    skip_node_##KNAME##_##VNAME##_t *update[SKIPLIST_MAXLEVEL] = {}; \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for(int i=l->level-1; i>=0; i--){ \
+        while(cur->level[i].forward != l->header && COMPARE(cur->level[i].forward->key, key) < 0){ \
+            cur = cur->level[i].forward; \
+        } \
+        update[i] = cur; \
+    } \
+    cur = cur->level[0].forward; \
+    if(cur == l->header || COMPARE(cur->key, key) != 0){ \
+        return false; \
+    } \
+    skip_list_unlink_##KNAME##_##VNAME(l, cur, update); \
+    free(cur); \
+    return true; \
+} \
+\
+static inline bool skip_list_remove_node_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, skip_node_##KNAME##_##VNAME##_t *node){ \
+    if(node == NULL || node == l->header){ \
+        return false; \
+    } \
+    skip_node_##KNAME##_##VNAME##_t *update[SKIPLIST_MAXLEVEL] = {}; \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for(int i=l->level-1; i>=0; i--){ \
+        while(cur->level[i].forward != l->header){ \
+            int comp = COMPARE(cur->level[i].forward->key, node->key); \
+            if(comp < 0 || (comp == 0 && cur->level[i].forward < node)){ \
+                cur = cur->level[i].forward; \
+            }else{ \
+                break; \
+            } \
+        } \
+        update[i] = cur; \
+    } \
+    if(cur->level[0].forward != node){ \
+        return false; \
+    } \
+    skip_list_unlink_##KNAME##_##VNAME(l, node, update); \
+    free(node); \
+    return true; \
+}
+
+
+#define DEF_SKIP_LIST_RANK(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+static inline unsigned long skip_list_get_rank_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, KEY_TYPE key){ \
+    unsigned long rank = 0; \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for (int i = l->level-1; i >= 0; i--) { \
+        while(cur->level[i].forward != l->header && COMPARE(cur->level[i].forward->key, key) < 0){ \
+            rank += cur->level[i].span; \
+            cur = cur->level[i].forward; \
+        } \
+    } \
+    rank += cur->level[0].span; \
+    cur = cur->level[0].forward; \
+    if(cur != l->header && COMPARE(cur->key, key) == 0){ \
+        return rank; \
+    }else{ \
+        return 0; \
+    } \
+} \
+\
+static inline unsigned long skip_list_get_node_rank_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, skip_node_##KNAME##_##VNAME##_t *node){ \
+    if(node == NULL || node == l->header){ \
+        return 0; \
+    } \
+    unsigned long rank = 0; \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for(int i = l->level-1; i >= 0; i--) { \
+        while(cur->level[i].forward != l->header){ \
+            int comp = COMPARE(cur->level[i].forward->key, node->key); \
+            if(comp < 0 || (comp == 0 && cur->level[i].forward <= node)){ \
+                rank += cur->level[i].span; \
+                cur = cur->level[i].forward; \
+            }else{ \
+                break; \
+            } \
+        } \
+    } \
+    return cur == node ? rank : 0; \
+} \
+\
+static inline skip_node_##KNAME##_##VNAME##_t *skip_list_get_node_by_rank_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l, unsigned long rank){ \
+    if(rank == 0 || rank > l->length){ \
+        return NULL; \
+    } \
+    unsigned long traversed = 0; \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header; \
+    for (int i = l->level-1; i >= 0; i--) { \
+        while (cur->level[i].forward != l->header && (traversed + cur->level[i].span) <= rank){ \
+            traversed += cur->level[i].span; \
+            cur = cur->level[i].forward; \
+        } \
+        if (traversed == rank){ \
+            return cur; \
+        } \
+    } \
+    return NULL; \
+}
+
+
+#define DEF_SKIP_LIST_CREATE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+static inline skip_list_##KNAME##_##VNAME##_t* skip_list_create_##KNAME##_##VNAME(void){ \
+    skip_list_##KNAME##_##VNAME##_t *slist = malloc(sizeof(*slist)); \
+    slist->level = 1; \
+    slist->length = 0; \
+    skip_node_##KNAME##_##VNAME##_t *header = skip_node_create_##KNAME##_##VNAME(SKIPLIST_MAXLEVEL, (KEY_TYPE){0}, (VALUE_TYPE){0}); \
+    header->backward = header; \
+    for(int i=0; i<SKIPLIST_MAXLEVEL; i++){ \
+        header->level[i].forward = header; \
+        header->level[i].span = 0; \
+    } \
+    slist->header = header; \
+    slist->insert = &skip_list_insert_##KNAME##_##VNAME; \
+    slist->insert_multi = &skip_list_insert_multi_##KNAME##_##VNAME; \
+    slist->find = &skip_list_find_##KNAME##_##VNAME; \
+    slist->remove = &skip_list_remove_##KNAME##_##VNAME; \
+    slist->remove_node = &skip_list_remove_node_##KNAME##_##VNAME; \
+    slist->get_rank = &skip_list_get_rank_##KNAME##_##VNAME; \
+    slist->get_node_rank = &skip_list_get_node_rank_##KNAME##_##VNAME; \
+    slist->get_node_by_rank = &skip_list_get_node_by_rank_##KNAME##_##VNAME; \
+    return slist; \
+} \
+\
+static inline void skip_list_destroy_##KNAME##_##VNAME(skip_list_##KNAME##_##VNAME##_t *l){ \
+    skip_node_##KNAME##_##VNAME##_t *cur = l->header->level[0].forward; \
+    while(cur != l->header){ \
+        skip_node_##KNAME##_##VNAME##_t *next = cur->level[0].forward; \
+        free(cur); \
+        cur = next; \
+    } \
+    free(l->header); \
+    free(l); \
+}
+
+
+#define DEF_SKIP_LIST(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+DEF_SKIP_LIST_TYPE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+DEF_SKIP_NODE_CREATE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+DEF_SKIP_LIST_LINK(KEY_TYPE, KNAME, VALUE_TYPE, VNAME) \
+DEF_SKIP_LIST_INSERT(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+DEF_SKIP_LIST_INSERT_MULTI(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+DEF_SKIP_LIST_FIND(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+DEF_SKIP_LIST_REMOVE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+DEF_SKIP_LIST_RANK(KEY_TYPE, KNAME, VALUE_TYPE, VNAME, COMPARE) \
+DEF_SKIP_LIST_CREATE(KEY_TYPE, KNAME, VALUE_TYPE, VNAME)
+
+
+#endif //ifndef SKIPLIST2_H